@@ -0,0 +1,197 @@
+// Requests per CPU second and system calls per request of the event loop
+// backends, the platform default against io_uring where it is built in.
+//
+// A forked server answers every 64 byte request with a 256 byte response.
+// The client keeps N connections busy the way wrk does: on readable it
+// reads with aeRead() until a read comes back short, writes the next
+// request at once and only polls for writable when a write would block.
+// Each backend runs 2s and prints requests per second, requests per CPU
+// second of the client alone, and the client's system calls per request.
+// Both processes share the CPUs, requests/cpu s is the figure to compare.
+//
+//   make bench            or   obj/bench/backends [N ...]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ae.h"
+
+#define RUN_US   2000000
+#define REQUEST  64
+#define RESPONSE 256
+
+typedef struct {
+    int fd;
+    size_t received;
+} conn;
+
+static char request[REQUEST], response[RESPONSE], buf[8192];
+static long requests, writes;
+
+static double cpu() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+         + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void nonblock(int fd) {
+    int one = 1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void served(aeEventLoop *loop, int fd, void *data, int mask) {
+    size_t *pending = data;
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        *pending += n;
+        for (; *pending >= REQUEST; *pending -= REQUEST) {
+            if (write(fd, response, RESPONSE) != RESPONSE) break;
+        }
+    }
+    if (n == 0 || (n == -1 && errno != EAGAIN)) {
+        aeDeleteFileEvent(loop, fd, AE_READABLE);
+        close(fd);
+        free(pending);
+    }
+}
+
+static void accepted(aeEventLoop *loop, int fd, void *data, int mask) {
+    int c;
+
+    while ((c = accept(fd, NULL, NULL)) != -1) {
+        nonblock(c);
+        aeCreateFileEvent(loop, c, AE_READABLE, served, calloc(1, sizeof(size_t)));
+    }
+}
+
+// Serve on an ephemeral port from a child process, returns the port.
+static int serve(pid_t *pid) {
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &addr, len) || listen(fd, 1024) ||
+        getsockname(fd, (struct sockaddr *) &addr, &len)) {
+        perror("server");
+        exit(1);
+    }
+
+    if ((*pid = fork()) == 0) {
+        aeEventLoop *loop = aeCreateEventLoop(1024);
+        nonblock(fd);
+        aeCreateFileEvent(loop, fd, AE_READABLE, accepted, NULL);
+        aeMain(loop);
+        exit(0);
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static void send_request(aeEventLoop *loop, int fd, void *data, int mask) {
+    writes++;
+    if (write(fd, request, REQUEST) == REQUEST) {
+        aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+    } else {
+        aeCreateFileEvent(loop, fd, AE_WRITABLE, send_request, data);
+    }
+}
+
+static void receive(aeEventLoop *loop, int fd, void *data, int mask) {
+    conn *c = data;
+    ssize_t n;
+
+    do {
+        if ((n = aeRead(loop, fd, buf, sizeof(buf))) <= 0) {
+            if (n == -1 && errno == EAGAIN) return;
+            fprintf(stderr, "connection lost\n");
+            exit(1);
+        }
+        c->received += n;
+        while (c->received >= RESPONSE) {
+            c->received -= RESPONSE;
+            requests++;
+            send_request(loop, fd, c, AE_WRITABLE);
+        }
+    } while (n == sizeof(buf));
+}
+
+static void run(const char *backend, int port, int n) {
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    aeEventLoop *loop = NULL;
+
+    if (aeSelectApi(backend) == AE_OK) loop = aeCreateEventLoop(n + 16);
+    if (!loop) {
+        printf("%-9s %6d  unavailable\n", backend, n);
+        return;
+    }
+    conn *cs = calloc(n, sizeof(conn));
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    for (int i = 0; i < n; i++) {
+        conn *c = &cs[i];
+        c->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr))) {
+            perror("connect");
+            exit(1);
+        }
+        nonblock(c->fd);
+        aeCreateFileEvent(loop, c->fd, AE_READABLE | AE_RECV, receive, c);
+        send_request(loop, c->fd, c, AE_WRITABLE);
+    }
+
+    requests = writes = 0;
+    loop->syscalls = 0;
+    double start_cpu = cpu();
+    monotime start = getMonotonicUs();
+    while (getMonotonicUs() - start < RUN_US) {
+        aeProcessEvents(loop, AE_ALL_EVENTS);
+    }
+    double used = cpu() - start_cpu;
+
+    printf("%-9s %6d %12.0f %14.0f %12.2f\n", backend, n, requests / (RUN_US / 1e6),
+           requests / used, (double) (loop->syscalls + writes) / requests);
+
+    for (int i = 0; i < n; i++) {
+        aeDeleteFileEvent(loop, cs[i].fd, AE_READABLE | AE_WRITABLE);
+        close(cs[i].fd);
+    }
+    aeDeleteEventLoop(loop);
+    free(cs);
+}
+
+int main(int argc, char **argv) {
+    int sizes[] = { 10, 100, 1000 };
+    int count = argc > 1 ? argc - 1 : 3;
+    char *backend = aeGetApiName();
+    pid_t server;
+
+    monotonicInit();
+    signal(SIGPIPE, SIG_IGN);
+    int port = serve(&server);
+
+    printf("%-9s %6s %12s %14s %12s\n", "backend", "conns", "requests/s", "requests/cpu s", "syscalls/req");
+    for (int i = 0; i < count; i++) {
+        int n = argc > 1 ? atoi(argv[i + 1]) : sizes[i];
+        run(backend, port, n);
+        run("io_uring", port, n);
+    }
+
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Cost of the connection layout when events land on random connections.
+//
+// Makes the field accesses of socket_writeable(), socket_readable() and
+// response_complete() for one request, on connections picked at random
+// among N, and prints the time per request. Without --phases or a
+// response() script a request only touches the hot part, with --phases it
+// also stamps the send and first byte times in the cold part. Before the
+// split into hot and cold parts every request did both, and read the
+// response() header buffer. Building this file against that wrk.h with
+// OLD_LAYOUT defined gives the old layout's numbers:
+//
+//   mkdir -p /tmp/old && git show 9d0013a~1:src/wrk.h > /tmp/old/wrk.h
+//   cc -O2 -DOLD_LAYOUT -I/tmp/old -Isrc -Iobj/include/luajit-2.1
+//       -o /tmp/old/layout bench/layout.c
+//
+// With hardware counters the misses themselves can be compared, and the
+// same events counted for wrk on a single thread with many connections:
+//
+//   perf stat -e cache-references,cache-misses obj/bench/layout 100000
+//   perf stat -e cache-references,cache-misses ./wrk -t1 -c10000 -d10s URL
+//
+//   make bench            or   obj/bench/layout [N ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "wrk.h"
+
+#define EVENTS 20000000
+
+#ifdef OLD_LAYOUT
+#define COLD(c) (c)
+#else
+#define COLD(c) ((c)->cold)
+#endif
+
+static volatile uint64_t sink;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void run(size_t n, bool phases) {
+    connection *cs = calloc(n, sizeof(connection));
+    uint64_t x = 88172645463325252ULL, sum = 0;
+    size_t size = sizeof(connection);
+    const char *label = "";
+
+#ifdef OLD_LAYOUT
+    // Every request stamped the send time and checked for response().
+    bool stamp = true, response = true;
+#else
+    bool stamp = phases, response = false;
+    label = phases ? " (--phases)" : "           ";
+    connection_cold *cold = calloc(n, sizeof(connection_cold));
+    for (size_t i = 0; i < n; i++) {
+        cs[i].cold = &cold[i];
+    }
+    size += phases ? sizeof(connection_cold) : 0;
+#endif
+
+    double start = now();
+    for (uint64_t i = 0; i < EVENTS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        connection *c = &cs[x % n];
+
+        // socket_writeable()
+        sum += c->delayed + c->written + c->scheduled + (uintptr_t) c->request;
+        c->deadline.expires = i;
+        c->start   = i;
+        c->pending = 1;
+        if (stamp) {
+            COLD(c)->sent       = i;
+            COLD(c)->first_byte = 0;
+        }
+        c->written += c->length;
+        // socket_readable()
+        sum += c->fd + c->parser.nread;
+        c->parser.nread += 3;
+        if (phases && !COLD(c)->first_byte) COLD(c)->first_byte = i;
+        // response_complete()
+        sum += c->tag;
+        if (response) sum += (uintptr_t) COLD(c)->headers.buffer;
+        c->pending--;
+        sum += c->start + c->deadline.index;
+        c->scheduled += 3;
+        if (phases) sum += COLD(c)->first_byte - COLD(c)->sent;
+        c->written = 0;
+    }
+    double elapsed = now() - start;
+    sink = sum;
+
+    printf("  %8zu connections of %3zuB%s  %6.1fns/request\n",
+           n, size, label, elapsed * 1e9 / EVENTS);
+    free(cs);
+#ifndef OLD_LAYOUT
+    free(cold);
+#endif
+}
+
+int main(int argc, char **argv) {
+    size_t sizes[] = { 10000, 100000, 1000000 };
+    size_t *n = sizes, count = 3;
+
+    if (argc > 1) {
+        count = argc - 1;
+        n = calloc(count, sizeof(size_t));
+        for (size_t i = 0; i < count; i++) {
+            n[i] = strtoul(argv[i + 1], NULL, 10);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        run(n[i], false);
+#ifndef OLD_LAYOUT
+        run(n[i], true);
+#endif
+    }
+    return 0;
+}
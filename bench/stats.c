@@ -0,0 +1,115 @@
+// Latency recording throughput by thread count: every thread recording into
+// one shared histogram with atomics, as wrk did before histograms became
+// per-thread, against private histograms merged once the threads finish.
+//
+//   make bench            or   obj/bench/stats [max threads] [records]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stats.h"
+#include "zmalloc.h"
+
+#define LIMIT 2000000
+
+typedef struct {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t data[LIMIT];
+} shared;
+
+typedef struct {
+    pthread_t thread;
+    uint64_t records;
+    shared *shared;
+    stats *stats;
+} worker;
+
+static shared *global;
+
+// The record path of the flat, shared histogram wrk used to have.
+static void shared_record(shared *s, uint64_t n) {
+    __sync_fetch_and_add(&s->data[n], 1);
+    __sync_fetch_and_add(&s->count, 1);
+    uint64_t min = s->min;
+    uint64_t max = s->max;
+    while (n < min) min = __sync_val_compare_and_swap(&s->min, min, n);
+    while (n > max) max = __sync_val_compare_and_swap(&s->max, max, n);
+}
+
+// Latencies of 100us to about 13ms, mostly short like a busy server's.
+static uint64_t latency(uint64_t *seed) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint64_t r = *seed >> 33;
+    return 100 + (r & 1023) * ((r >> 10) & 3 ? 1 : 12);
+}
+
+static void *record(void *arg) {
+    worker *w = arg;
+    uint64_t seed = (uintptr_t) w;
+
+    for (uint64_t i = 0; i < w->records; i++) {
+        uint64_t n = latency(&seed);
+        if (w->shared) {
+            shared_record(w->shared, n);
+        } else {
+            stats_record(w->stats, n);
+        }
+    }
+    return NULL;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Records per second of all threads together, merge included.
+static double run(int threads, uint64_t records, int private) {
+    worker *workers = zcalloc(threads * sizeof(worker));
+    stats *total = stats_alloc(LIMIT - 1, 2);
+
+    global->count = global->max = 0;
+    global->min = UINT64_MAX;
+
+    double start = now();
+    for (int i = 0; i < threads; i++) {
+        workers[i].records = records;
+        workers[i].shared  = private ? NULL : global;
+        workers[i].stats   = private ? stats_alloc(LIMIT - 1, 2) : NULL;
+        pthread_create(&workers[i].thread, NULL, record, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (private) {
+            stats_merge(total, workers[i].stats);
+            stats_free(workers[i].stats);
+        }
+    }
+    double elapsed = now() - start;
+
+    stats_free(total);
+    zfree(workers);
+    return threads * records / elapsed;
+}
+
+int main(int argc, char **argv) {
+    int max = argc > 1 ? atoi(argv[1]) : 16;
+    uint64_t records = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+
+    global = zcalloc(sizeof(shared));
+
+    printf("%-8s %16s %16s\n", "threads", "shared rec/s", "private rec/s");
+    for (int threads = 1; threads <= max; threads *= 2) {
+        double a = run(threads, records, 0);
+        double b = run(threads, records, 1);
+        printf("%-8d %16.0f %16.0f\n", threads, a, b);
+    }
+
+    zfree(global);
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Time event throughput of one event loop with many timers in flight.
+//
+// idle:   N timers 60s out, plus 100 timers firing every millisecond that
+//         each cancel one idle timer and create a new one, like delay()
+//         requests among many waiting connections.
+// rearm:  N timers firing every 1-50ms, each re-armed from its callback.
+//
+// Each case runs 2s and prints timers fired per second and CPU time. The
+// API is that of the original ae, so building this file against ae.c from
+// before the time events became a heap gives the list's numbers.
+//
+//   make bench            or   obj/bench/timers [N ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "ae.h"
+
+#define RUN_US 2000000
+
+static long fired;
+static long long *idle;
+static int idles;
+
+static int cancel_idle(aeEventLoop *loop, long long id, void *data) {
+    int i = rand() % idles;
+    fired++;
+    aeDeleteTimeEvent(loop, idle[i]);
+    idle[i] = aeCreateTimeEvent(loop, 60000, cancel_idle, NULL, NULL);
+    return 1;
+}
+
+static int rearm(aeEventLoop *loop, long long id, void *data) {
+    fired++;
+    return 1 + rand() % 50;
+}
+
+static double cpu() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+         + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void run(const char *name, int n, int idle_case) {
+    aeEventLoop *loop = aeCreateEventLoop(64);
+
+    fired = 0;
+    if (idle_case) {
+        idles = n;
+        idle  = malloc(n * sizeof(long long));
+        for (int i = 0; i < n; i++) {
+            idle[i] = aeCreateTimeEvent(loop, 60000, cancel_idle, NULL, NULL);
+        }
+        for (int i = 0; i < 100; i++) {
+            aeCreateTimeEvent(loop, 1, cancel_idle, NULL, NULL);
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            aeCreateTimeEvent(loop, 1 + rand() % 50, rearm, NULL, NULL);
+        }
+    }
+
+    double start_cpu = cpu();
+    monotime start = getMonotonicUs();
+    while (getMonotonicUs() - start < RUN_US) {
+        aeProcessEvents(loop, AE_ALL_EVENTS);
+    }
+
+    printf("%-6s %8d %14.0f %10.2f\n", name, n, fired / (RUN_US / 1e6), cpu() - start_cpu);
+    aeDeleteEventLoop(loop);
+    if (idle_case) free(idle);
+}
+
+int main(int argc, char **argv) {
+    int sizes[] = { 1000, 10000, 100000 };
+    int count = argc > 1 ? argc - 1 : 3;
+
+    monotonicInit();
+
+    printf("%-6s %8s %14s %10s\n", "case", "timers", "fired/s", "cpu s");
+    for (int i = 0; i < count; i++) {
+        int n = argc > 1 ? atoi(argv[i + 1]) : sizes[i];
+        run("idle", n, 1);
+        run("rearm", n, 0);
+    }
+    return 0;
+}
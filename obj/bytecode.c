@@ -0,0 +1,47 @@
+#ifdef __cplusplus
+extern "C"
+#endif
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const unsigned char luaJIT_BC_wrk[] = {
+27,76,74,2,10,139,1,0,2,11,1,5,0,24,45,2,0,0,57,2,0,2,18,4,0,0,18,5,1,0,66,2,
+3,2,21,3,2,0,41,4,1,0,41,5,255,255,77,3,12,128,45,7,0,0,57,7,1,7,56,9,6,2,66,
+7,2,2,14,0,7,0,88,7,5,128,54,7,2,0,57,7,3,7,18,9,2,0,18,10,6,0,66,7,3,1,79,3,
+244,127,45,3,0,0,61,2,4,3,75,0,1,0,0,192,10,97,100,100,114,115,11,114,101,109,
+111,118,101,10,116,97,98,108,101,12,99,111,110,110,101,99,116,11,108,111,111,
+107,117,112,92,0,1,4,1,5,0,13,45,1,0,0,57,1,1,1,58,1,1,1,61,1,0,0,54,1,2,0,54,
+3,3,0,66,1,2,2,7,1,4,0,88,1,3,128,54,1,3,0,18,3,0,0,66,1,2,1,75,0,1,0,0,192,
+13,102,117,110,99,116,105,111,110,10,115,101,116,117,112,9,116,121,112,101,10,
+97,100,100,114,115,9,97,100,100,114,17,0,0,1,1,0,0,2,45,0,0,0,76,0,2,0,1,192,
+142,2,1,1,7,1,14,0,48,45,1,0,0,57,1,0,1,57,1,1,1,14,0,1,0,88,1,27,128,45,1,0,
+0,57,1,2,1,45,2,0,0,57,2,3,2,18,5,1,0,57,3,4,1,39,6,5,0,66,3,3,2,15,0,3,0,88,
+4,6,128,39,3,6,0,18,4,1,0,39,5,7,0,38,3,5,3,12,1,3,0,88,4,0,128,15,0,2,0,88,3,
+6,128,18,3,1,0,39,4,5,0,18,5,2,0,38,3,5,3,12,1,3,0,88,4,0,128,45,3,0,0,57,3,0,
+3,61,1,1,3,54,1,8,0,54,3,9,0,66,1,2,2,7,1,10,0,88,1,3,128,54,1,9,0,18,3,0,0,
+66,1,2,1,45,1,0,0,57,1,11,1,66,1,1,2,45,2,0,0,51,3,13,0,61,3,12,2,50,0,0,128,
+75,0,1,0,0,192,0,12,114,101,113,117,101,115,116,11,102,111,114,109,97,116,13,
+102,117,110,99,116,105,111,110,9,105,110,105,116,9,116,121,112,101,6,93,6,91,
+6,58,9,102,105,110,100,9,112,111,114,116,9,104,111,115,116,9,72,111,115,116,
+12,104,101,97,100,101,114,115,134,3,0,4,20,1,16,1,68,12,4,0,0,88,4,2,128,45,4,
+0,0,57,4,0,4,12,5,1,0,88,5,2,128,45,5,0,0,57,5,1,5,12,6,2,0,88,6,2,128,45,6,0,
+0,57,6,2,6,12,7,3,0,88,7,2,128,45,7,0,0,57,7,3,7,52,8,0,0,57,9,4,6,14,0,9,0,
+88,9,4,128,45,9,0,0,57,9,2,9,57,9,4,9,61,9,4,6,13,9,7,0,88,9,4,128,54,9,6,0,
+57,9,7,9,18,11,7,0,66,9,2,2,61,9,5,6,54,9,6,0,57,9,8,9,39,11,9,0,18,12,4,0,18,
+13,5,0,66,9,4,2,62,9,1,8,54,9,10,0,18,11,6,0,66,9,2,4,72,12,9,128,21,14,8,0,
+22,14,0,14,54,15,6,0,57,15,8,15,39,17,11,0,18,18,12,0,18,19,13,0,66,15,4,2,60,
+15,14,8,70,12,3,3,82,12,245,127,21,9,8,0,22,9,0,9,39,10,12,0,60,10,9,8,21,9,8,
+0,22,9,0,9,12,10,7,0,88,10,1,128,39,10,12,0,60,10,9,8,54,9,13,0,57,9,14,9,18,
+11,8,0,39,12,15,0,68,9,3,0,0,192,7,13,10,11,99,111,110,99,97,116,10,116,97,98,
+108,101,5,11,37,115,58,32,37,115,10,112,97,105,114,115,19,37,115,32,37,115,32,
+72,84,84,80,47,49,46,49,11,102,111,114,109,97,116,8,108,101,110,11,115,116,
+114,105,110,103,19,67,111,110,116,101,110,116,45,76,101,110,103,116,104,9,72,
+111,115,116,9,98,111,100,121,12,104,101,97,100,101,114,115,9,112,97,116,104,
+11,109,101,116,104,111,100,2,145,1,3,0,2,0,10,0,13,53,0,0,0,52,1,0,0,61,1,1,0,
+51,1,3,0,61,1,2,0,51,1,5,0,61,1,4,0,51,1,7,0,61,1,6,0,51,1,9,0,61,1,8,0,50,0,
+0,128,76,0,2,0,0,11,102,111,114,109,97,116,0,9,105,110,105,116,0,10,115,101,
+116,117,112,0,12,114,101,115,111,108,118,101,12,104,101,97,100,101,114,115,1,
+0,4,9,104,111,115,116,14,108,111,99,97,108,104,111,115,116,11,115,99,104,101,
+109,101,9,104,116,116,112,9,112,97,116,104,6,47,11,109,101,116,104,111,100,8,
+71,69,84,0
+};
@@ -39,11 +39,56 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "ae.h"
 #include "zmalloc.h"
 #include "config.h"
 
+#define AE_FILE_CHUNK (1<<AE_FILE_CHUNK_BITS)
+
+static inline aeFileEvent *aeFileEventAt(aeEventLoop *eventLoop, int slot) {
+    return &eventLoop->events[slot>>AE_FILE_CHUNK_BITS][slot&(AE_FILE_CHUNK-1)];
+}
+
+/* Fibonacci hashing, fds of a loop are often spread evenly over the fds of
+ * the process (one in every N with N threads). */
+static inline unsigned int aeFdHash(aeEventLoop *eventLoop, int fd) {
+    return ((unsigned int)fd*2654435769U) >> (32-eventLoop->fdmapBits);
+}
+
+/* Return the slot of fd, or -1 if it has no file event. */
+static int aeFdSlotFind(aeEventLoop *eventLoop, int fd) {
+    unsigned int mask = (1U<<eventLoop->fdmapBits)-1;
+    unsigned int j = aeFdHash(eventLoop,fd);
+
+    while (eventLoop->fdmap[j].fd != -1) {
+        if (eventLoop->fdmap[j].fd == fd) return eventLoop->fdmap[j].slot;
+        j = (j+1) & mask;
+    }
+    return -1;
+}
+
+/* Run the handlers of a fired file event. Backends that register a pointer
+ * to the aeFileEvent with the kernel call this straight from their result
+ * buffer, the others fill eventLoop->fired for aeProcessEvents(). */
+static inline void aeFireFileEvent(aeEventLoop *eventLoop, aeFileEvent *fe,
+        int mask) {
+    int rfired = 0;
+
+    /* note the fe->mask & mask & ... code: maybe an already processed
+     * event removed an element that fired and we still didn't
+     * processed, so we check if the event is still valid. */
+    if (fe->mask & mask & AE_READABLE) {
+        rfired = 1;
+        fe->rfileProc(eventLoop,fe->fd,fe->clientData,mask);
+    }
+    if (fe->mask & mask & AE_WRITABLE) {
+        if (!rfired || fe->wfileProc != fe->rfileProc)
+            fe->wfileProc(eventLoop,fe->fd,fe->clientData,mask);
+    }
+}
+
 /* Include the best multiplexing layer supported by this system.
  * The following should be ordered by performances, descending. */
 #ifdef HAVE_EVPORT
@@ -60,31 +105,178 @@
     #endif
 #endif
 
+#ifdef HAVE_IO_URING
+#include "ae_io_uring.c"
+#endif
+
+/* Multiplexing layers that can be chosen at runtime, the first one is
+ * the default. */
+typedef struct aeApi {
+    int (*create)(aeEventLoop *eventLoop);
+    int (*resize)(aeEventLoop *eventLoop, int setsize);
+    void (*free)(aeEventLoop *eventLoop);
+    int (*addEvent)(aeEventLoop *eventLoop, int slot, int mask);
+    void (*delEvent)(aeEventLoop *eventLoop, int slot, int mask);
+    ssize_t (*read)(aeEventLoop *eventLoop, int slot, void *buf, size_t len);
+    int (*poll)(aeEventLoop *eventLoop, struct timeval *tvp);
+    int (*process)(aeEventLoop *eventLoop, struct timeval *tvp);
+    char *(*name)(void);
+} aeApi;
+
+/* A layer either fills eventLoop->fired from poll(), or waits and runs the
+ * handlers itself in process(), which must also update eventLoop->now.
+ * A layer with read() may receive for AE_RECV events, see aeRead(). */
+static const aeApi aeApis[] = {
+#ifdef AE_API_DISPATCH
+    {aeApiCreate, aeApiResize, aeApiFree, aeApiAddEvent, aeApiDelEvent,
+     NULL, NULL, aeApiProcess, aeApiName},
+#else
+    {aeApiCreate, aeApiResize, aeApiFree, aeApiAddEvent, aeApiDelEvent,
+     NULL, aeApiPoll, NULL, aeApiName},
+#endif
+#ifdef HAVE_IO_URING
+    {aeUringCreate, aeUringResize, aeUringFree, aeUringAddEvent,
+     aeUringDelEvent, aeUringRead, aeUringPoll, NULL, aeUringName},
+#endif
+};
+
+static const aeApi *aeApiSelected = &aeApis[0];
+
+/* Select the multiplexing layer of event loops created from now on by its
+ * aeGetApiName() name. Returns AE_ERR if it's not available in this build. */
+int aeSelectApi(const char *name) {
+    size_t j;
+
+    for (j = 0; j < sizeof(aeApis)/sizeof(aeApis[0]); j++) {
+        if (strcmp(aeApis[j].name(), name) == 0) {
+            aeApiSelected = &aeApis[j];
+            return AE_OK;
+        }
+    }
+    return AE_ERR;
+}
+
+static void aeFdSlotInsert(aeEventLoop *eventLoop, int fd, int slot) {
+    unsigned int mask = (1U<<eventLoop->fdmapBits)-1;
+    unsigned int j = aeFdHash(eventLoop,fd);
+
+    while (eventLoop->fdmap[j].fd != -1) j = (j+1) & mask;
+    eventLoop->fdmap[j].fd = fd;
+    eventLoop->fdmap[j].slot = slot;
+}
+
+/* Remove fd from the table, moving back the entries that follow it in its
+ * probe sequence so that lookups never need tombstones. */
+static void aeFdSlotRemove(aeEventLoop *eventLoop, int fd) {
+    aeFdSlot *map = eventLoop->fdmap;
+    unsigned int mask = (1U<<eventLoop->fdmapBits)-1;
+    unsigned int hole = aeFdHash(eventLoop,fd), j, home;
+
+    while (map[hole].fd != fd) {
+        if (map[hole].fd == -1) return;
+        hole = (hole+1) & mask;
+    }
+    for (j = (hole+1) & mask; map[j].fd != -1; j = (j+1) & mask) {
+        home = aeFdHash(eventLoop,map[j].fd);
+        /* Entries whose home is cyclically in (hole, j] stay put. */
+        if (hole < j ? (home > hole && home <= j) : (home > hole || home <= j))
+            continue;
+        map[hole] = map[j];
+        hole = j;
+    }
+    map[hole].fd = -1;
+}
+
+/* Size the fd table for setsize entries at a load factor of at most 1/2
+ * and insert the registered fds again. */
+static int aeFdMapResize(aeEventLoop *eventLoop, int setsize) {
+    aeFdSlot *old = eventLoop->fdmap;
+    int oldsize = old ? 1<<eventLoop->fdmapBits : 0;
+    int bits = 1, j;
+
+    while ((1<<bits) < setsize*2) bits++;
+    if (old && bits == eventLoop->fdmapBits) return AE_OK;
+    eventLoop->fdmap = zmalloc(sizeof(aeFdSlot)<<bits);
+    if (eventLoop->fdmap == NULL) {
+        eventLoop->fdmap = old;
+        return AE_ERR;
+    }
+    eventLoop->fdmapBits = bits;
+    for (j = 0; j < 1<<bits; j++) eventLoop->fdmap[j].fd = -1;
+    for (j = 0; j < oldsize; j++)
+        if (old[j].fd != -1) aeFdSlotInsert(eventLoop,old[j].fd,old[j].slot);
+    zfree(old);
+    return AE_OK;
+}
+
+/* Hand out a free slot, growing the set when all of them are in use. */
+static int aeSlotAlloc(aeEventLoop *eventLoop) {
+    aeFileEvent **chunk;
+    int slot, j;
+
+    if (eventLoop->slotFreeCount)
+        return eventLoop->slotFree[--eventLoop->slotFreeCount];
+    if (eventLoop->slotTop == eventLoop->setsize &&
+        aeResizeSetSize(eventLoop,eventLoop->setsize*2) == AE_ERR)
+        return -1;
+    slot = eventLoop->slotTop;
+    chunk = &eventLoop->events[slot>>AE_FILE_CHUNK_BITS];
+    if (*chunk == NULL) {
+        if ((*chunk = zmalloc(sizeof(aeFileEvent)*AE_FILE_CHUNK)) == NULL)
+            return -1;
+        for (j = 0; j < AE_FILE_CHUNK; j++) (*chunk)[j].mask = AE_NONE;
+    }
+    eventLoop->slotTop++;
+    return slot;
+}
+
+static void aeSlotRelease(aeEventLoop *eventLoop, int slot) {
+    aeFdSlotRemove(eventLoop,aeFileEventAt(eventLoop,slot)->fd);
+    eventLoop->slotFree[eventLoop->slotFreeCount++] = slot;
+    eventLoop->count--;
+}
+
+static int aeChunkCount(int setsize) {
+    return (setsize+AE_FILE_CHUNK-1) >> AE_FILE_CHUNK_BITS;
+}
+
 aeEventLoop *aeCreateEventLoop(int setsize) {
     aeEventLoop *eventLoop;
-    int i;
 
-    if ((eventLoop = zmalloc(sizeof(*eventLoop))) == NULL) goto err;
-    eventLoop->events = zmalloc(sizeof(aeFileEvent)*setsize);
+    if (setsize < 1) setsize = 1;
+    if ((eventLoop = zcalloc(sizeof(*eventLoop))) == NULL) goto err;
+    eventLoop->events = zcalloc(sizeof(aeFileEvent *)*aeChunkCount(setsize));
+    eventLoop->slotFree = zmalloc(sizeof(int)*setsize);
     eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
-    if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
+    if (eventLoop->events == NULL || eventLoop->slotFree == NULL ||
+        eventLoop->fired == NULL || aeFdMapResize(eventLoop,setsize) == AE_ERR)
+        goto err;
     eventLoop->setsize = setsize;
-    eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
+    eventLoop->now = getMonotonicUs();
+    eventLoop->timeEvents = NULL;
+    eventLoop->timeEventHeap = NULL;
+    eventLoop->timeEventCount = 0;
+    eventLoop->timeEventSize = 0;
+    eventLoop->timeEventFree = -1;
     eventLoop->timeEventNextId = 0;
+    eventLoop->deadlines = NULL;
+    eventLoop->deadlineCount = 0;
+    eventLoop->deadlineSize = 0;
     eventLoop->stop = 0;
-    eventLoop->maxfd = -1;
+    eventLoop->syscalls = 0;
+    eventLoop->count = 0;
+    eventLoop->slotTop = 0;
+    eventLoop->slotFreeCount = 0;
     eventLoop->beforesleep = NULL;
-    if (aeApiCreate(eventLoop) == -1) goto err;
-    /* Events with mask == AE_NONE are not set. So let's initialize the
-     * vector with it. */
-    for (i = 0; i < setsize; i++)
-        eventLoop->events[i].mask = AE_NONE;
+    eventLoop->api = aeApiSelected;
+    if (eventLoop->api->create(eventLoop) == -1) goto err;
     return eventLoop;
 
 err:
     if (eventLoop) {
         zfree(eventLoop->events);
+        zfree(eventLoop->slotFree);
+        zfree(eventLoop->fdmap);
         zfree(eventLoop->fired);
         zfree(eventLoop);
     }
@@ -96,34 +288,44 @@ int aeGetSetSize(aeEventLoop *eventLoop) {
     return eventLoop->setsize;
 }
 
-/* Resize the maximum set size of the event loop.
- * If the requested set size is smaller than the current set size, but
- * there is already a file descriptor in use that is >= the requested
- * set size minus one, AE_ERR is returned and the operation is not
+/* Resize the maximum set size of the event loop, the number of file
+ * descriptors it can watch at once. aeCreateFileEvent() doubles it when
+ * the set is full. If the requested set size is smaller than the number
+ * of slots handed out so far, AE_ERR is returned and the operation is not
  * performed at all.
  *
  * Otherwise AE_OK is returned and the operation is successful. */
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
-    int i;
+    int oldchunks = aeChunkCount(eventLoop->setsize);
+    int chunks = aeChunkCount(setsize), j;
 
     if (setsize == eventLoop->setsize) return AE_OK;
-    if (eventLoop->maxfd >= setsize) return AE_ERR;
-    if (aeApiResize(eventLoop,setsize) == -1) return AE_ERR;
-
-    eventLoop->events = zrealloc(eventLoop->events,sizeof(aeFileEvent)*setsize);
+    if (eventLoop->slotTop > setsize) return AE_ERR;
+    if (eventLoop->api->resize(eventLoop,setsize) == -1) return AE_ERR;
+    if (aeFdMapResize(eventLoop,setsize) == AE_ERR) return AE_ERR;
+
+    /* Chunks past slotTop are unused, drop them when shrinking. */
+    for (j = chunks; j < oldchunks; j++) zfree(eventLoop->events[j]);
+    eventLoop->events = zrealloc(eventLoop->events,sizeof(aeFileEvent *)*chunks);
+    for (j = oldchunks; j < chunks; j++) eventLoop->events[j] = NULL;
+    eventLoop->slotFree = zrealloc(eventLoop->slotFree,sizeof(int)*setsize);
     eventLoop->fired = zrealloc(eventLoop->fired,sizeof(aeFiredEvent)*setsize);
     eventLoop->setsize = setsize;
-
-    /* Make sure that if we created new slots, they are initialized with
-     * an AE_NONE mask. */
-    for (i = eventLoop->maxfd+1; i < setsize; i++)
-        eventLoop->events[i].mask = AE_NONE;
     return AE_OK;
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
-    aeApiFree(eventLoop);
+    int j;
+
+    eventLoop->api->free(eventLoop);
+    zfree(eventLoop->timeEvents);
+    zfree(eventLoop->timeEventHeap);
+    zfree(eventLoop->deadlines);
+    for (j = 0; j < aeChunkCount(eventLoop->setsize); j++)
+        zfree(eventLoop->events[j]);
     zfree(eventLoop->events);
+    zfree(eventLoop->slotFree);
+    zfree(eventLoop->fdmap);
     zfree(eventLoop->fired);
     zfree(eventLoop);
 }
@@ -135,200 +337,314 @@ void aeStop(aeEventLoop *eventLoop) {
 int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData)
 {
-    if (fd >= eventLoop->setsize) {
-        errno = ERANGE;
-        return AE_ERR;
+    int slot = aeFdSlotFind(eventLoop, fd);
+    aeFileEvent *fe;
+
+    if (slot == -1) {
+        if ((slot = aeSlotAlloc(eventLoop)) == -1) {
+            errno = ERANGE;
+            return AE_ERR;
+        }
+        fe = aeFileEventAt(eventLoop, slot);
+        fe->fd = fd;
+        aeFdSlotInsert(eventLoop, fd, slot);
+        eventLoop->count++;
     }
-    aeFileEvent *fe = &eventLoop->events[fd];
+    fe = aeFileEventAt(eventLoop, slot);
 
-    if (aeApiAddEvent(eventLoop, fd, mask) == -1)
+    /* Only replacing the handler needs no change in the kernel. */
+    if ((fe->mask & mask) != mask &&
+        eventLoop->api->addEvent(eventLoop, slot, mask) == -1) {
+        if (fe->mask == AE_NONE) aeSlotRelease(eventLoop, slot);
         return AE_ERR;
+    }
     fe->mask |= mask;
     if (mask & AE_READABLE) fe->rfileProc = proc;
     if (mask & AE_WRITABLE) fe->wfileProc = proc;
     fe->clientData = clientData;
-    if (fd > eventLoop->maxfd)
-        eventLoop->maxfd = fd;
     return AE_OK;
 }
 
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
 {
-    if (fd >= eventLoop->setsize) return;
-    aeFileEvent *fe = &eventLoop->events[fd];
-    if (fe->mask == AE_NONE) return;
+    int slot = aeFdSlotFind(eventLoop, fd);
+    aeFileEvent *fe;
 
-    aeApiDelEvent(eventLoop, fd, mask);
-    fe->mask = fe->mask & (~mask);
-    if (fd == eventLoop->maxfd && fe->mask == AE_NONE) {
-        /* Update the max fd */
-        int j;
+    if (slot == -1) return;
+    fe = aeFileEventAt(eventLoop, slot);
+    if (mask & AE_READABLE) mask |= AE_RECV;
+    if ((fe->mask & mask) == AE_NONE) return;
 
-        for (j = eventLoop->maxfd-1; j >= 0; j--)
-            if (eventLoop->events[j].mask != AE_NONE) break;
-        eventLoop->maxfd = j;
-    }
+    eventLoop->api->delEvent(eventLoop, slot, mask);
+    fe->mask = fe->mask & (~mask);
+    if (fe->mask == AE_NONE) aeSlotRelease(eventLoop, slot);
 }
 
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
-    if (fd >= eventLoop->setsize) return 0;
-    aeFileEvent *fe = &eventLoop->events[fd];
+    int slot = aeFdSlotFind(eventLoop, fd);
 
-    return fe->mask;
+    if (slot == -1) return 0;
+    return aeFileEventAt(eventLoop, slot)->mask;
 }
 
-static void aeGetTime(long *seconds, long *milliseconds)
-{
-    struct timeval tv;
+/* Read from a fd registered with AE_READABLE|AE_RECV. Layers that receive
+ * for the fd copy out what they received, the others call read(2). The
+ * result is that of read(2): -1 with errno EAGAIN once nothing is left. */
+ssize_t aeRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len) {
+    if (eventLoop->api->read) {
+        int slot = aeFdSlotFind(eventLoop, fd);
 
-    gettimeofday(&tv, NULL);
-    *seconds = tv.tv_sec;
-    *milliseconds = tv.tv_usec/1000;
+        if (slot != -1 && aeFileEventAt(eventLoop, slot)->mask & AE_RECV)
+            return eventLoop->api->read(eventLoop, slot, buf, len);
+    }
+    eventLoop->syscalls++;
+    return read(fd, buf, len);
 }
 
-static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
-    long cur_sec, cur_ms, when_sec, when_ms;
+#define AE_TIME_SLOT_MASK ((1LL<<AE_TIME_SLOT_BITS)-1)
 
-    aeGetTime(&cur_sec, &cur_ms);
-    when_sec = cur_sec + milliseconds/1000;
-    when_ms = cur_ms + milliseconds%1000;
-    if (when_ms >= 1000) {
-        when_sec ++;
-        when_ms -= 1000;
+static void aeTimerSiftUp(aeEventLoop *eventLoop, int i) {
+    aeTimer *heap = eventLoop->timeEventHeap;
+    aeTimer t = heap[i];
+
+    while (i > 0) {
+        int parent = (i-1)/2;
+        if (heap[parent].when <= t.when) break;
+        heap[i] = heap[parent];
+        i = parent;
     }
-    *sec = when_sec;
-    *ms = when_ms;
+    heap[i] = t;
 }
 
-long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
+static void aeTimerSiftDown(aeEventLoop *eventLoop, int i) {
+    aeTimer *heap = eventLoop->timeEventHeap;
+    aeTimer t = heap[i];
+    int count = eventLoop->timeEventCount;
+
+    while (2*i+1 < count) {
+        int child = 2*i+1;
+        if (child+1 < count && heap[child+1].when < heap[child].when)
+            child++;
+        if (t.when <= heap[child].when) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = t;
+}
+
+static void aeTimerPush(aeEventLoop *eventLoop, int slot, monotime when) {
+    aeTimer *t = &eventLoop->timeEventHeap[eventLoop->timeEventCount++];
+    t->when = when;
+    t->slot = slot;
+    aeTimerSiftUp(eventLoop, eventLoop->timeEventCount-1);
+}
+
+static void aeTimerPop(aeEventLoop *eventLoop) {
+    int count = --eventLoop->timeEventCount;
+    if (count == 0) return;
+    eventLoop->timeEventHeap[0] = eventLoop->timeEventHeap[count];
+    aeTimerSiftDown(eventLoop, 0);
+}
+
+/* Return the slot to the free list, the finalizer may create time events
+ * and so move the slot array. */
+static void aeTimerRelease(aeEventLoop *eventLoop, int slot) {
+    aeTimeEvent *te = &eventLoop->timeEvents[slot];
+    aeEventFinalizerProc *finalizerProc = te->finalizerProc;
+    void *clientData = te->clientData;
+
+    te->id = AE_DELETED_EVENT_ID;
+    te->finalizerProc = NULL;
+    te->next = eventLoop->timeEventFree;
+    eventLoop->timeEventFree = slot;
+    if (finalizerProc)
+        finalizerProc(eventLoop, clientData);
+}
+
+long long aeCreateTimeEventUs(aeEventLoop *eventLoop, long long microseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc)
 {
-    long long id = eventLoop->timeEventNextId++;
     aeTimeEvent *te;
+    int slot;
+
+    if (eventLoop->timeEventFree == -1) {
+        int size = eventLoop->timeEventSize ? eventLoop->timeEventSize*2 : 64;
+        if (size > (1<<AE_TIME_SLOT_BITS)) return AE_ERR;
+        eventLoop->timeEvents = zrealloc(eventLoop->timeEvents, sizeof(aeTimeEvent)*size);
+        eventLoop->timeEventHeap = zrealloc(eventLoop->timeEventHeap, sizeof(aeTimer)*size);
+        for (slot = size-1; slot >= eventLoop->timeEventSize; slot--) {
+            eventLoop->timeEvents[slot].id = AE_DELETED_EVENT_ID;
+            eventLoop->timeEvents[slot].next = eventLoop->timeEventFree;
+            eventLoop->timeEventFree = slot;
+        }
+        eventLoop->timeEventSize = size;
+    }
+
+    slot = eventLoop->timeEventFree;
+    te = &eventLoop->timeEvents[slot];
+    eventLoop->timeEventFree = te->next;
 
-    te = zmalloc(sizeof(*te));
-    if (te == NULL) return AE_ERR;
-    te->id = id;
-    aeAddMillisecondsToNow(milliseconds,&te->when_sec,&te->when_ms);
+    /* The sequence number keeps ids of reused slots distinct. */
+    te->id = (long long)(((unsigned long long)eventLoop->timeEventNextId++
+            << AE_TIME_SLOT_BITS) & LLONG_MAX) | slot;
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
-    return id;
+    aeTimerPush(eventLoop, slot, getMonotonicUs() + microseconds);
+    return te->id;
+}
+
+long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
+        aeTimeProc *proc, void *clientData,
+        aeEventFinalizerProc *finalizerProc)
+{
+    return aeCreateTimeEventUs(eventLoop, milliseconds*1000, proc, clientData,
+            finalizerProc);
 }
 
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-            te->id = AE_DELETED_EVENT_ID;
-            return AE_OK;
-        }
-        te = te->next;
+    long long slot = id & AE_TIME_SLOT_MASK;
+    aeTimeEvent *te;
+
+    if (id < 0 || slot >= eventLoop->timeEventSize) return AE_ERR;
+    te = &eventLoop->timeEvents[slot];
+    if (te->id != id) return AE_ERR; /* NO event with the specified ID found */
+
+    /* processTimeEvents() releases the slot when it comes up. */
+    te->id = AE_DELETED_EVENT_ID;
+    return AE_OK;
+}
+
+static void aeDeadlinePlace(aeEventLoop *eventLoop, aeDeadline *d, int i) {
+    eventLoop->deadlines[i] = d;
+    d->index = i+1;
+}
+
+static void aeDeadlineSiftUp(aeEventLoop *eventLoop, int i) {
+    aeDeadline *d = eventLoop->deadlines[i];
+
+    while (i > 0) {
+        int parent = (i-1)/2;
+        if (eventLoop->deadlines[parent]->when <= d->when) break;
+        aeDeadlinePlace(eventLoop, eventLoop->deadlines[parent], i);
+        i = parent;
     }
-    return AE_ERR; /* NO event with the specified ID found */
+    aeDeadlinePlace(eventLoop, d, i);
 }
 
-/* Search the first timer to fire.
- * This operation is useful to know how many time the select can be
- * put in sleep without to delay any event.
- * If there are no timers NULL is returned.
- *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
-static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
-{
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
+static void aeDeadlineSiftDown(aeEventLoop *eventLoop, int i) {
+    aeDeadline *d = eventLoop->deadlines[i];
+    int count = eventLoop->deadlineCount;
+
+    while (2*i+1 < count) {
+        int child = 2*i+1;
+        if (child+1 < count &&
+            eventLoop->deadlines[child+1]->when < eventLoop->deadlines[child]->when)
+            child++;
+        if (d->when <= eventLoop->deadlines[child]->when) break;
+        aeDeadlinePlace(eventLoop, eventLoop->deadlines[child], i);
+        i = child;
     }
-    return nearest;
+    aeDeadlinePlace(eventLoop, d, i);
 }
 
-/* Process time events */
-static int processTimeEvents(aeEventLoop *eventLoop) {
-    int processed = 0;
-    aeTimeEvent *te, *prev;
-    long long maxId;
-    time_t now = time(NULL);
-
-    /* If the system clock is moved to the future, and then set back to the
-     * right value, time events may be delayed in a random way. Often this
-     * means that scheduled operations will not be performed soon enough.
-     *
-     * Here we try to detect system clock skews, and force all the time
-     * events to be processed ASAP when this happens: the idea is that
-     * processing events earlier is less dangerous than delaying them
-     * indefinitely, and practice suggests it is. */
-    if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
+/* Arm the deadline to fire in the given number of milliseconds from the
+ * start of this iteration. Moving it later is O(1), queueing it or moving
+ * it earlier is O(log(N)). */
+void aeSetDeadline(aeEventLoop *eventLoop, aeDeadline *deadline, long long milliseconds) {
+    monotime when = eventLoop->now + milliseconds*1000;
+
+    deadline->expires = when;
+    if (deadline->index == 0) {
+        if (eventLoop->deadlineCount == eventLoop->deadlineSize) {
+            eventLoop->deadlineSize = eventLoop->deadlineSize ? eventLoop->deadlineSize*2 : 64;
+            eventLoop->deadlines = zrealloc(eventLoop->deadlines,
+                    sizeof(aeDeadline *)*eventLoop->deadlineSize);
         }
+        deadline->when = when;
+        eventLoop->deadlines[eventLoop->deadlineCount++] = deadline;
+        aeDeadlineSiftUp(eventLoop, eventLoop->deadlineCount-1);
+    } else if (when < deadline->when) {
+        deadline->when = when;
+        aeDeadlineSiftUp(eventLoop, deadline->index-1);
     }
-    eventLoop->lastTime = now;
-
-    prev = NULL;
-    te = eventLoop->timeEventHead;
-    maxId = eventLoop->timeEventNextId-1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
-
-        /* Remove events scheduled for deletion. */
-        if (te->id == AE_DELETED_EVENT_ID) {
-            aeTimeEvent *next = te->next;
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizerProc)
-                te->finalizerProc(eventLoop, te->clientData);
-            zfree(te);
-            te = next;
+}
+
+/* Disarm the deadline, its heap entry is dropped when it reaches the top. */
+void aeClearDeadline(aeEventLoop *eventLoop, aeDeadline *deadline) {
+    AE_NOTUSED(eventLoop);
+    deadline->expires = 0;
+}
+
+/* Fire expired deadlines, requeueing those that were pushed back. */
+static int processDeadlines(aeEventLoop *eventLoop) {
+    int processed = 0;
+    monotime now = eventLoop->now;
+
+    while (eventLoop->deadlineCount && eventLoop->deadlines[0]->when <= now) {
+        aeDeadline *d = eventLoop->deadlines[0];
+
+        if (d->expires > now) {
+            d->when = d->expires;
+            aeDeadlineSiftDown(eventLoop, 0);
             continue;
         }
 
-        /* Make sure we don't process time events created by time events in
-         * this iteration. Note that this check is currently useless: we always
-         * add new timers on the head, however if we change the implementation
-         * detail, this check may be useful again: we keep it here for future
-         * defense. */
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
+        d->index = 0;
+        if (--eventLoop->deadlineCount) {
+            eventLoop->deadlines[0] = eventLoop->deadlines[eventLoop->deadlineCount];
+            aeDeadlineSiftDown(eventLoop, 0);
         }
-        aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
+
+        if (d->expires) {
+            d->expires = 0;
+            d->proc(eventLoop, d->clientData);
             processed++;
-            if (retval != AE_NOMORE) {
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                te->id = AE_DELETED_EVENT_ID;
-            }
         }
-        prev = te;
-        te = te->next;
+    }
+    return processed;
+}
+
+/* Process time events. Every due event is taken off the heap before any
+ * callback runs, so events created or rescheduled by the callbacks are
+ * not processed before the next iteration. */
+static int processTimeEvents(aeEventLoop *eventLoop) {
+    int processed = 0;
+    monotime now = eventLoop->now;
+    int firing = -1, *tail = &firing;
+
+    while (eventLoop->timeEventCount && eventLoop->timeEventHeap[0].when <= now) {
+        int slot = eventLoop->timeEventHeap[0].slot;
+        aeTimerPop(eventLoop);
+        eventLoop->timeEvents[slot].next = -1;
+        *tail = slot;
+        tail = &eventLoop->timeEvents[slot].next;
+    }
+
+    while (firing != -1) {
+        int slot = firing;
+        aeTimeEvent *te = &eventLoop->timeEvents[slot];
+        long long id = te->id;
+        int retval;
+
+        firing = te->next;
+        if (id == AE_DELETED_EVENT_ID) {
+            aeTimerRelease(eventLoop, slot);
+            continue;
+        }
+
+        retval = te->timeProc(eventLoop, id, te->clientData);
+        processed++;
+
+        /* The callback may have created events and moved the slots. */
+        te = &eventLoop->timeEvents[slot];
+        if (retval != AE_NOMORE && te->id != AE_DELETED_EVENT_ID) {
+            aeTimerPush(eventLoop, slot, now + retval*1000);
+        } else {
+            aeTimerRelease(eventLoop, slot);
+        }
     }
     return processed;
 }
@@ -357,29 +673,29 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
      * file events to process as long as we want to process time
      * events, in order to sleep until the next time event is ready
      * to fire. */
-    if (eventLoop->maxfd != -1 ||
+    if (eventLoop->count != 0 ||
         ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
         int j;
-        aeTimeEvent *shortest = NULL;
         struct timeval tv, *tvp;
 
-        if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT))
-            shortest = aeSearchNearestTimer(eventLoop);
-        if (shortest) {
-            long now_sec, now_ms;
+        monotime when = 0;
 
-            aeGetTime(&now_sec, &now_ms);
+        if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT)) {
+            if (eventLoop->timeEventCount)
+                when = eventLoop->timeEventHeap[0].when;
+            if (eventLoop->deadlineCount &&
+                (!when || eventLoop->deadlines[0]->when < when))
+                when = eventLoop->deadlines[0]->when;
+        }
+        if (when) {
+            monotime now = getMonotonicUs();
             tvp = &tv;
 
-            /* How many milliseconds we need to wait for the next
-             * time event to fire? */
-            long long ms =
-                (shortest->when_sec - now_sec)*1000 +
-                shortest->when_ms - now_ms;
-
-            if (ms > 0) {
-                tvp->tv_sec = ms/1000;
-                tvp->tv_usec = (ms % 1000)*1000;
+            /* How many microseconds we need to wait for the next
+             * time event or deadline to fire? */
+            if (when > now) {
+                tvp->tv_sec = (when - now)/1000000;
+                tvp->tv_usec = (when - now)%1000000;
             } else {
                 tvp->tv_sec = 0;
                 tvp->tv_usec = 0;
@@ -397,34 +713,35 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
             }
         }
 
-        numevents = aeApiPoll(eventLoop, tvp);
-        for (j = 0; j < numevents; j++) {
-            aeFileEvent *fe = &eventLoop->events[eventLoop->fired[j].fd];
-            int mask = eventLoop->fired[j].mask;
-            int fd = eventLoop->fired[j].fd;
-            int rfired = 0;
-
-	    /* note the fe->mask & mask & ... code: maybe an already processed
-             * event removed an element that fired and we still didn't
-             * processed, so we check if the event is still valid. */
-            if (fe->mask & mask & AE_READABLE) {
-                rfired = 1;
-                fe->rfileProc(eventLoop,fd,fe->clientData,mask);
-            }
-            if (fe->mask & mask & AE_WRITABLE) {
-                if (!rfired || fe->wfileProc != fe->rfileProc)
-                    fe->wfileProc(eventLoop,fd,fe->clientData,mask);
+        if (eventLoop->api->process) {
+            processed += eventLoop->api->process(eventLoop, tvp);
+        } else {
+            numevents = eventLoop->api->poll(eventLoop, tvp);
+            eventLoop->now = getMonotonicUs();
+            for (j = 0; j < numevents; j++) {
+                aeFiredEvent *fired = &eventLoop->fired[j];
+
+                aeFireFileEvent(eventLoop,aeFileEventAt(eventLoop,fired->slot),
+                        fired->mask);
+                processed++;
             }
-            processed++;
         }
     }
     /* Check time events */
-    if (flags & AE_TIME_EVENTS)
+    if (flags & AE_TIME_EVENTS) {
         processed += processTimeEvents(eventLoop);
+        processed += processDeadlines(eventLoop);
+    }
 
     return processed; /* return the number of processed file/time events */
 }
 
+/* Time at which the current iteration's poll returned. Cheaper than reading
+ * the clock and accurate enough for anything but measuring latency. */
+monotime aeNow(aeEventLoop *eventLoop) {
+    return eventLoop->now;
+}
+
 /* Wait for milliseconds until the given file descriptor becomes
  * writable/readable/exception */
 int aeWait(int fd, int mask, long long milliseconds) {
@@ -457,7 +774,7 @@ void aeMain(aeEventLoop *eventLoop) {
 }
 
 char *aeGetApiName(void) {
-    return aeApiName();
+    return aeApiSelected->name();
 }
 
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
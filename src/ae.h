@@ -34,6 +34,9 @@
 #define __AE_H__
 
 #include <time.h>
+#include <sys/types.h>
+
+#include "monotonic.h"
 
 #define AE_OK 0
 #define AE_ERR -1
@@ -41,6 +44,7 @@
 #define AE_NONE 0
 #define AE_READABLE 1
 #define AE_WRITABLE 2
+#define AE_RECV 4 /* with AE_READABLE: the backend may read, see aeRead() */
 
 #define AE_FILE_EVENTS 1
 #define AE_TIME_EVENTS 2
@@ -49,6 +53,8 @@
 
 #define AE_NOMORE -1
 #define AE_DELETED_EVENT_ID -1
+#define AE_TIME_SLOT_BITS 24
+#define AE_FILE_CHUNK_BITS 8
 
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
@@ -60,42 +66,88 @@ typedef void aeFileProc(struct aeEventLoop *eventLoop, int fd, void *clientData,
 typedef int aeTimeProc(struct aeEventLoop *eventLoop, long long id, void *clientData);
 typedef void aeEventFinalizerProc(struct aeEventLoop *eventLoop, void *clientData);
 typedef void aeBeforeSleepProc(struct aeEventLoop *eventLoop);
+typedef void aeDeadlineProc(struct aeEventLoop *eventLoop, void *clientData);
 
-/* File event structure */
+/* File event structure. Events live in slots allocated in chunks of
+ * 1<<AE_FILE_CHUNK_BITS that never move, so a backend may hand their
+ * address to the kernel. The fdmap of the loop finds the slot of a fd. */
 typedef struct aeFileEvent {
-    int mask; /* one of AE_(READABLE|WRITABLE) */
+    int mask; /* one of AE_(READABLE|WRITABLE|RECV) */
+    int fd;
     aeFileProc *rfileProc;
     aeFileProc *wfileProc;
     void *clientData;
 } aeFileEvent;
 
-/* Time event structure */
+/* Time event structure. Events live in a slot array that is reused as
+ * events come and go, the low AE_TIME_SLOT_BITS of an id name the slot.
+ * Deleting an event only marks it, the slot is released once its heap
+ * entry comes up. */
 typedef struct aeTimeEvent {
-    long long id; /* time event identifier. */
-    long when_sec; /* seconds */
-    long when_ms; /* milliseconds */
+    long long id; /* time event identifier, AE_DELETED_EVENT_ID if deleted */
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    int next; /* next free slot, or next event firing in this iteration */
 } aeTimeEvent;
 
+/* Timer heap entry, the time is kept inline so that sifting does not have
+ * to visit the slots. */
+typedef struct aeTimer {
+    monotime when;
+    int slot;
+} aeTimer;
+
+/* Deadline embedded in a client structure. It sits in a binary heap
+ * ordered by 'when' and is only moved when it is brought forward: pushing
+ * it back just updates 'expires', and the heap entry is requeued once its
+ * old time is reached. Clearing it sets 'expires' to 0. The structure must
+ * be zeroed before first use and stay valid while it is queued. */
+typedef struct aeDeadline {
+    monotime when; /* position in the heap */
+    monotime expires; /* 0 if not armed */
+    int index; /* 1-based heap index, 0 if not queued */
+    aeDeadlineProc *proc;
+    void *clientData;
+} aeDeadline;
+
+/* Entry of the open addressing table mapping a fd to its file event */
+typedef struct aeFdSlot {
+    int fd; /* -1 if the entry is empty */
+    int slot;
+} aeFdSlot;
+
 /* A fired event */
 typedef struct aeFiredEvent {
-    int fd;
+    int slot;
     int mask;
 } aeFiredEvent;
 
 /* State of an event based program */
 typedef struct aeEventLoop {
-    int maxfd;   /* highest file descriptor currently registered */
-    int setsize; /* max number of file descriptors tracked */
+    int count;   /* file descriptors currently registered */
+    int setsize; /* max number of file descriptors, grown when full */
     long long timeEventNextId;
-    time_t lastTime;     /* Used to detect system clock skew */
-    aeFileEvent *events; /* Registered events */
+    monotime now; /* Clock read once per iteration, see aeNow() */
+    aeFileEvent **events; /* Chunks of file event slots */
+    int slotTop; /* Slots below it have been handed out */
+    int *slotFree; /* Released slots, reused first */
+    int slotFreeCount;
+    aeFdSlot *fdmap; /* fd -> slot, 1<<fdmapBits entries */
+    int fdmapBits;
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    aeTimeEvent *timeEvents; /* Time event slots */
+    aeTimer *timeEventHeap; /* Min-heap of queued slots ordered by 'when' */
+    int timeEventCount; /* Queued time events */
+    int timeEventSize; /* Allocated slots */
+    int timeEventFree; /* First unused slot, -1 if none */
+    aeDeadline **deadlines; /* Min-heap of queued deadlines */
+    int deadlineCount;
+    int deadlineSize;
     int stop;
+    long long syscalls; /* Made by the multiplexing layer and aeRead(),
+                           except evport */
+    const struct aeApi *api; /* Multiplexing layer, see aeSelectApi() */
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
 } aeEventLoop;
@@ -108,14 +160,22 @@ int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData);
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask);
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd);
+ssize_t aeRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len);
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc);
+long long aeCreateTimeEventUs(aeEventLoop *eventLoop, long long microseconds,
+        aeTimeProc *proc, void *clientData,
+        aeEventFinalizerProc *finalizerProc);
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id);
+void aeSetDeadline(aeEventLoop *eventLoop, aeDeadline *deadline, long long milliseconds);
+void aeClearDeadline(aeEventLoop *eventLoop, aeDeadline *deadline);
 int aeProcessEvents(aeEventLoop *eventLoop, int flags);
+monotime aeNow(aeEventLoop *eventLoop);
 int aeWait(int fd, int mask, long long milliseconds);
 void aeMain(aeEventLoop *eventLoop);
 char *aeGetApiName(void);
+int aeSelectApi(const char *name);
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep);
 int aeGetSetSize(aeEventLoop *eventLoop);
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize);
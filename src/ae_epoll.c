@@ -31,9 +31,14 @@
 
 #include <sys/epoll.h>
 
+/* Events carry a pointer to their aeFileEvent in data.ptr, so handlers run
+ * straight from the epoll_wait() buffer, see aeApiProcess(). */
+#define AE_API_DISPATCH
+
 typedef struct aeApiState {
     int epfd;
     struct epoll_event *events;
+    int pwait2; /* epoll_pwait2() may be used, cleared if the kernel lacks it */
 } aeApiState;
 
 static int aeApiCreate(aeEventLoop *eventLoop) {
@@ -51,6 +56,11 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
         zfree(state);
         return -1;
     }
+#ifdef HAVE_EPOLL_PWAIT2
+    state->pwait2 = 1;
+#else
+    state->pwait2 = 0;
+#endif
     eventLoop->apidata = state;
     return 0;
 }
@@ -70,64 +80,84 @@ static void aeApiFree(aeEventLoop *eventLoop) {
     zfree(state);
 }
 
-static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static int aeApiAddEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
+    aeFileEvent *fe = aeFileEventAt(eventLoop,slot);
     struct epoll_event ee = {0}; /* avoid valgrind warning */
     /* If the fd was already monitored for some event, we need a MOD
      * operation. Otherwise we need an ADD operation. */
-    int op = eventLoop->events[fd].mask == AE_NONE ?
-            EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    int op = fe->mask == AE_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
 
     ee.events = 0;
-    mask |= eventLoop->events[fd].mask; /* Merge old events */
+    mask |= fe->mask; /* Merge old events */
     if (mask & AE_READABLE) ee.events |= EPOLLIN;
     if (mask & AE_WRITABLE) ee.events |= EPOLLOUT;
-    ee.data.fd = fd;
-    if (epoll_ctl(state->epfd,op,fd,&ee) == -1) return -1;
+    ee.data.ptr = fe;
+    eventLoop->syscalls++;
+    if (epoll_ctl(state->epfd,op,fe->fd,&ee) == -1) return -1;
     return 0;
 }
 
-static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+static void aeApiDelEvent(aeEventLoop *eventLoop, int slot, int delmask) {
     aeApiState *state = eventLoop->apidata;
+    aeFileEvent *fe = aeFileEventAt(eventLoop,slot);
     struct epoll_event ee = {0}; /* avoid valgrind warning */
-    int mask = eventLoop->events[fd].mask & (~delmask);
+    int mask = fe->mask & (~delmask);
 
     ee.events = 0;
     if (mask & AE_READABLE) ee.events |= EPOLLIN;
     if (mask & AE_WRITABLE) ee.events |= EPOLLOUT;
-    ee.data.fd = fd;
+    ee.data.ptr = fe;
+    eventLoop->syscalls++;
     if (mask != AE_NONE) {
-        epoll_ctl(state->epfd,EPOLL_CTL_MOD,fd,&ee);
+        epoll_ctl(state->epfd,EPOLL_CTL_MOD,fe->fd,&ee);
     } else {
         /* Note, Kernel < 2.6.9 requires a non null event pointer even for
          * EPOLL_CTL_DEL. */
-        epoll_ctl(state->epfd,EPOLL_CTL_DEL,fd,&ee);
+        epoll_ctl(state->epfd,EPOLL_CTL_DEL,fe->fd,&ee);
     }
 }
 
-static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
-    aeApiState *state = eventLoop->apidata;
-    int retval, numevents = 0;
-
-    retval = epoll_wait(state->epfd,state->events,eventLoop->setsize,
-            tvp ? (tvp->tv_sec*1000 + tvp->tv_usec/1000) : -1);
-    if (retval > 0) {
-        int j;
-
-        numevents = retval;
-        for (j = 0; j < numevents; j++) {
-            int mask = 0;
-            struct epoll_event *e = state->events+j;
-
-            if (e->events & EPOLLIN) mask |= AE_READABLE;
-            if (e->events & EPOLLOUT) mask |= AE_WRITABLE;
-            if (e->events & EPOLLERR) mask |= AE_WRITABLE;
-            if (e->events & EPOLLHUP) mask |= AE_WRITABLE;
-            eventLoop->fired[j].fd = e->data.fd;
-            eventLoop->fired[j].mask = mask;
+/* Wait with microsecond precision when epoll_pwait2() is available, the
+ * epoll_wait() timeout is rounded up to the next millisecond. */
+static int aeApiWait(aeApiState *state, int setsize, struct timeval *tvp) {
+#ifdef HAVE_EPOLL_PWAIT2
+    if (state->pwait2) {
+        struct timespec ts, *tsp = NULL;
+        int retval;
+
+        if (tvp) {
+            ts.tv_sec = tvp->tv_sec;
+            ts.tv_nsec = tvp->tv_usec * 1000;
+            tsp = &ts;
         }
+        retval = epoll_pwait2(state->epfd,state->events,setsize,tsp,NULL);
+        if (retval != -1 || errno != ENOSYS) return retval;
+        state->pwait2 = 0; /* Kernel older than 5.11 */
+    }
+#endif
+    return epoll_wait(state->epfd,state->events,setsize,
+            tvp ? (tvp->tv_sec*1000 + (tvp->tv_usec+999)/1000) : -1);
+}
+
+static int aeApiProcess(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    int j, numevents;
+
+    numevents = aeApiWait(state,eventLoop->setsize,tvp);
+    eventLoop->syscalls++;
+    eventLoop->now = getMonotonicUs();
+    for (j = 0; j < numevents; j++) {
+        struct epoll_event *e = state->events+j;
+        int mask = 0;
+
+        if (e->events & EPOLLIN) mask |= AE_READABLE;
+        if (e->events & EPOLLOUT) mask |= AE_WRITABLE;
+        if (e->events & EPOLLERR) mask |= AE_WRITABLE;
+        if (e->events & EPOLLHUP) mask |= AE_WRITABLE;
+        aeFireFileEvent(eventLoop,e->data.ptr,mask);
     }
-    return numevents;
+    return numevents > 0 ? numevents : 0;
 }
 
 static char *aeApiName(void) {
@@ -149,9 +149,10 @@ static int aeApiAssociate(const char *where, int portfd, int fd, int mask) {
     return rv;
 }
 
-static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static int aeApiAddEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
-    int fullmask, pfd;
+    aeFileEvent *fe = aeFileEventAt(eventLoop, slot);
+    int fd = fe->fd, fullmask, pfd;
 
     if (evport_debug)
         fprintf(stderr, "aeApiAddEvent: fd %d mask 0x%x\n", fd, mask);
@@ -161,7 +162,7 @@ static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
      * must be sure to include whatever events are already associated when
      * we call port_associate() again.
      */
-    fullmask = mask | eventLoop->events[fd].mask;
+    fullmask = mask | fe->mask;
     pfd = aeApiLookupPending(state, fd);
 
     if (pfd != -1) {
@@ -180,9 +181,10 @@ static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
     return (aeApiAssociate("aeApiAddEvent", state->portfd, fd, fullmask));
 }
 
-static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static void aeApiDelEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
-    int fullmask, pfd;
+    aeFileEvent *fe = aeFileEventAt(eventLoop, slot);
+    int fd = fe->fd, fullmask, pfd;
 
     if (evport_debug)
         fprintf(stderr, "del fd %d mask 0x%x\n", fd, mask);
@@ -214,7 +216,7 @@ static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int mask) {
      * the fact that our caller has already updated the mask in the eventLoop.
      */
 
-    fullmask = eventLoop->events[fd].mask;
+    fullmask = fe->mask;
     if (fullmask == AE_NONE) {
         /*
          * We're removing *all* events, so use port_dissociate to remove the
@@ -243,8 +245,8 @@ static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int mask) {
 static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
     aeApiState *state = eventLoop->apidata;
     struct timespec timeout, *tsp;
-    int mask, i;
-    uint_t nevents;
+    int mask, i, slot, numevents = 0;
+    uint_t nevents, max;
     port_event_t event[MAX_EVENT_BATCHSZ];
 
     /*
@@ -282,7 +284,9 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
      * So if we get ETIME, we check nevents, too.
      */
     nevents = 1;
-    if (port_getn(state->portfd, event, MAX_EVENT_BATCHSZ, &nevents,
+    max = eventLoop->setsize < MAX_EVENT_BATCHSZ ?
+        eventLoop->setsize : MAX_EVENT_BATCHSZ; /* room in fired */
+    if (port_getn(state->portfd, event, max, &nevents,
         tsp) == -1 && (errno != ETIME || nevents == 0)) {
         if (errno == ETIME || errno == EINTR)
             return 0;
@@ -301,8 +305,12 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
             if (event[i].portev_events & POLLOUT)
                 mask |= AE_WRITABLE;
 
-            eventLoop->fired[i].fd = event[i].portev_object;
-            eventLoop->fired[i].mask = mask;
+            slot = aeFdSlotFind(eventLoop, event[i].portev_object);
+            if (slot != -1) {
+                eventLoop->fired[numevents].slot = slot;
+                eventLoop->fired[numevents].mask = mask;
+                numevents++;
+            }
 
             if (evport_debug)
                 fprintf(stderr, "aeApiPoll: fd %d mask 0x%x\n",
@@ -312,7 +320,7 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
             state->pending_masks[i] = (uintptr_t)event[i].portev_user;
     }
 
-    return nevents;
+    return numevents;
 }
 
 static char *aeApiName(void) {
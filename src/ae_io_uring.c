@@ -0,0 +1,532 @@
+/* Linux io_uring based ae.c module, selected at runtime with aeSelectApi().
+ *
+ * File events are one-shot IORING_OP_POLL_ADD requests. A poll that has
+ * completed is re-armed with the current mask just before the next wait,
+ * so interest changes made by the callbacks cost no system call and are
+ * submitted in one io_uring_enter() together with the wait itself. Arming
+ * again after every completion keeps the level-triggered semantics of the
+ * other backends.
+ *
+ * Events registered with AE_READABLE|AE_RECV are not polled for reading: a
+ * multishot IORING_OP_RECV receives into buffers of a ring provided to the
+ * kernel, the fd fires readable while received data is queued and aeRead()
+ * copies it out and hands the buffers back without a system call. Reading
+ * a response then costs no more than the wait that reaps it. Kernels
+ * without provided buffer rings or multishot recv (Linux 6.0), or builds
+ * against older headers, fall back to polling and read().
+ *
+ * The ring is mapped and driven with raw system calls, it needs Linux 5.11
+ * (single mmap, no CQ drops and timeouts passed to io_uring_enter()). */
+
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define AE_URING_MAX_SQ 4096
+#define AE_URING_IGNORE (~0ULL) /* user_data of POLL_REMOVE requests */
+#define AE_URING_RECV (1U<<31) /* set in the user_data of recv requests */
+#define AE_URING_SLOT (AE_URING_RECV-1)
+#define AE_URING_BUF_SIZE 8192 /* bytes of each provided buffer */
+#define AE_URING_MIN_BUFS 16
+#define AE_URING_MAX_BUFS 1024
+#define AE_URING_BGID 0
+
+/* Per slot state, user_data of a poll or recv is its generation and slot. */
+typedef struct aeUringFd {
+    unsigned int gen; /* generation of the last poll, in its user_data */
+    int armed; /* mask of the queued poll, AE_NONE if none */
+    int dirty; /* queued in the rearm list */
+    unsigned int recvGen; /* generation of the last recv */
+    int receiving; /* a multishot recv is queued */
+    int head, tail; /* buffers received and not read yet, -1 if none */
+    unsigned int offset; /* bytes of the head buffer already read */
+    int end; /* after the buffers: 1 on EOF, -errno on error, 0 if neither */
+    int ready; /* queued in the ready list */
+} aeUringFd;
+
+typedef struct aeUringState {
+    int ringfd;
+    void *ring;
+    size_t ringsz;
+    struct io_uring_sqe *sqes;
+    size_t sqesz;
+    unsigned *sqhead, *sqtail, sqmask, sqentries, sqlocal;
+    unsigned *cqhead, *cqtail, cqmask;
+    struct io_uring_cqe *cqes;
+    aeUringFd *fds;
+    int *rearm; /* slots whose poll must be queued before the next wait */
+    int rearmCount;
+    int recv; /* AE_RECV events are received into the buffer ring */
+    struct io_uring_buf_ring *br; /* buffer ring shared with the kernel */
+    size_t brsz;
+    unsigned brmask;
+    unsigned short brtail;
+    char *bufs;
+    unsigned *lens; /* bytes received into each buffer */
+    int *next; /* buffer received after this one on the same slot, or -1 */
+    int *ready; /* slots with received data or an end to report */
+    int readyCount;
+    long long syscalls; /* io_uring_enter() calls not yet accounted */
+} aeUringState;
+
+static int aeUringEnter(aeUringState *state, unsigned submit, unsigned wait,
+        unsigned flags, struct io_uring_getevents_arg *arg) {
+    state->syscalls++;
+    return syscall(__NR_io_uring_enter,state->ringfd,submit,wait,flags,
+            arg,arg ? sizeof(*arg) : 0);
+}
+
+/* Hand the queued SQEs to the kernel and wait for up to 'wait'
+ * completions, or until the timeout 'ts' expires when it's not NULL. */
+static void aeUringSubmit(aeUringState *state, unsigned wait,
+        struct __kernel_timespec *ts) {
+    struct io_uring_getevents_arg arg = {0};
+    unsigned submit = state->sqlocal - *state->sqhead;
+
+    __atomic_store_n(state->sqtail,state->sqlocal,__ATOMIC_RELEASE);
+    if (wait == 0 && submit == 0) return;
+
+    arg.sigmask_sz = _NSIG/8;
+    arg.ts = (unsigned long long)(uintptr_t)ts;
+    /* EINTR, ETIME and EBUSY (completions backlogged) only end the wait,
+     * whatever is in the completion queue is reaped by the caller. */
+    aeUringEnter(state,submit,wait,
+            IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,&arg);
+}
+
+static struct io_uring_sqe *aeUringGetSqe(aeUringState *state) {
+    struct io_uring_sqe *sqe;
+
+    if (state->sqlocal - __atomic_load_n(state->sqhead,__ATOMIC_ACQUIRE) ==
+        state->sqentries)
+        aeUringSubmit(state,0,NULL);
+    sqe = &state->sqes[state->sqlocal++ & state->sqmask];
+    memset(sqe,0,sizeof(*sqe));
+    return sqe;
+}
+
+static void aeUringArm(aeUringState *state, int slot, int fd, int mask) {
+    struct io_uring_sqe *sqe = aeUringGetSqe(state);
+    aeUringFd *f = &state->fds[slot];
+    unsigned int events = 0;
+
+    if (mask & AE_READABLE) events |= POLLIN;
+    if (mask & AE_WRITABLE) events |= POLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    events = events << 16 | events >> 16;
+#endif
+    f->gen++;
+    f->armed = mask;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = (unsigned long long)f->gen << 32 | (unsigned)slot;
+}
+
+static void aeUringArmRecv(aeUringState *state, int slot, int fd) {
+#ifdef IORING_RECV_MULTISHOT
+    struct io_uring_sqe *sqe = aeUringGetSqe(state);
+    aeUringFd *f = &state->fds[slot];
+
+    f->recvGen++;
+    f->receiving = 1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = AE_URING_BGID;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = (unsigned long long)f->recvGen << 32 |
+                     AE_URING_RECV | (unsigned)slot;
+#endif
+}
+
+/* Give a buffer back to the kernel. */
+static void aeUringRecycle(aeUringState *state, int bid) {
+#ifdef IORING_RECV_MULTISHOT
+    struct io_uring_buf *buf = &state->br->bufs[state->brtail & state->brmask];
+
+    buf->addr = (unsigned long long)(uintptr_t)
+                (state->bufs + (size_t)bid*AE_URING_BUF_SIZE);
+    buf->len = AE_URING_BUF_SIZE;
+    buf->bid = bid;
+    state->brtail++;
+    __atomic_store_n(&state->br->tail,state->brtail,__ATOMIC_RELEASE);
+#endif
+}
+
+/* Cancel the recv of a slot, if any, and drop whatever it received. */
+static void aeUringStopRecv(aeUringState *state, int slot) {
+    aeUringFd *f = &state->fds[slot];
+
+    if (f->receiving) {
+        struct io_uring_sqe *sqe = aeUringGetSqe(state);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (unsigned long long)f->recvGen << 32 |
+                    AE_URING_RECV | (unsigned)slot;
+        sqe->user_data = AE_URING_IGNORE;
+        f->receiving = 0;
+        /* Later completions of the cancelled recv are stale. */
+        f->recvGen++;
+    }
+    while (f->head != -1) {
+        int bid = f->head;
+        f->head = state->next[bid];
+        aeUringRecycle(state,bid);
+    }
+    f->tail = -1;
+    f->offset = 0;
+    f->end = 0;
+}
+
+/* Mask to poll for a slot whose events are 'mask', sets *recv when its
+ * data is received instead. */
+static int aeUringWants(aeUringState *state, int mask, int *recv) {
+    *recv = state->recv &&
+            (mask & (AE_READABLE|AE_RECV)) == (AE_READABLE|AE_RECV);
+    return mask & (*recv ? AE_WRITABLE : AE_READABLE|AE_WRITABLE);
+}
+
+static void aeUringMarkDirty(aeUringState *state, int slot) {
+    if (!state->fds[slot].dirty) {
+        state->fds[slot].dirty = 1;
+        state->rearm[state->rearmCount++] = slot;
+    }
+}
+
+/* Cancel the queued poll or recv of a slot if the new mask doesn't want
+ * it, and make sure what it wants is armed before the next wait. */
+static void aeUringUpdate(aeEventLoop *eventLoop, int slot, int mask) {
+    aeUringState *state = eventLoop->apidata;
+    aeUringFd *f = &state->fds[slot];
+    int recv, poll = aeUringWants(state,mask,&recv);
+
+    if (!recv) aeUringStopRecv(state,slot);
+    if (f->armed == poll && (!recv || f->receiving || f->end)) return;
+    if (f->armed != poll && f->armed != AE_NONE) {
+        struct io_uring_sqe *sqe = aeUringGetSqe(state);
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = (unsigned long long)f->gen << 32 | (unsigned)slot;
+        sqe->user_data = AE_URING_IGNORE;
+        f->armed = AE_NONE;
+    }
+    aeUringMarkDirty(state,slot);
+}
+
+static void aeUringFree(aeEventLoop *eventLoop) {
+    aeUringState *state = eventLoop->apidata;
+
+    if (state->sqes) munmap(state->sqes,state->sqesz);
+    if (state->ring) munmap(state->ring,state->ringsz);
+    if (state->ringfd != -1) close(state->ringfd);
+    if (state->br) munmap(state->br,state->brsz);
+    zfree(state->bufs);
+    zfree(state->lens);
+    zfree(state->next);
+    zfree(state->fds);
+    zfree(state->rearm);
+    zfree(state->ready);
+    zfree(state);
+}
+
+/* Register a ring of provided buffers for AE_RECV events, leaves recv off
+ * if the kernel can't take one. */
+static void aeUringSetupRecv(aeEventLoop *eventLoop) {
+#ifdef IORING_RECV_MULTISHOT
+    aeUringState *state = eventLoop->apidata;
+    struct io_uring_buf_reg reg;
+    unsigned entries = AE_URING_MIN_BUFS, i;
+    void *br;
+
+    while (entries < (unsigned)eventLoop->setsize && entries < AE_URING_MAX_BUFS)
+        entries *= 2;
+    state->brsz = entries*sizeof(struct io_uring_buf);
+    br = mmap(NULL,state->brsz,PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE,-1,0);
+    if (br == MAP_FAILED) return;
+    state->br = br;
+
+    memset(&reg,0,sizeof(reg));
+    reg.ring_addr = (unsigned long long)(uintptr_t)br;
+    reg.ring_entries = entries;
+    reg.bgid = AE_URING_BGID;
+    if (syscall(__NR_io_uring_register,state->ringfd,
+                IORING_REGISTER_PBUF_RING,&reg,1) != 0) return;
+
+    state->bufs = zmalloc((size_t)entries*AE_URING_BUF_SIZE);
+    state->lens = zmalloc(sizeof(unsigned)*entries);
+    state->next = zmalloc(sizeof(int)*entries);
+    if (!state->bufs || !state->lens || !state->next) return;
+    state->brmask = entries-1;
+    for (i = 0; i < entries; i++) aeUringRecycle(state,i);
+    state->recv = 1;
+#endif
+}
+
+static void aeUringInitFds(aeUringState *state, int from, int to) {
+    for (; from < to; from++) {
+        aeUringFd *f = &state->fds[from];
+        memset(f,0,sizeof(*f));
+        f->armed = AE_NONE;
+        f->head = f->tail = -1;
+    }
+}
+
+static int aeUringCreate(aeEventLoop *eventLoop) {
+    aeUringState *state = zcalloc(sizeof(aeUringState));
+    struct io_uring_params p;
+    unsigned entries = 8, required, i;
+    size_t sqsz, cqsz;
+    char *ring;
+
+    if (!state) return -1;
+    state->ringfd = -1;
+    eventLoop->apidata = state;
+
+    while (entries < (unsigned)eventLoop->setsize && entries < AE_URING_MAX_SQ)
+        entries *= 2;
+    memset(&p,0,sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE|IORING_SETUP_CLAMP;
+    p.cq_entries = eventLoop->setsize*2;
+    state->ringfd = syscall(__NR_io_uring_setup,entries,&p);
+    if (state->ringfd == -1) goto err;
+
+    required = IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP|IORING_FEAT_EXT_ARG;
+    if ((p.features & required) != required) goto err;
+
+    sqsz = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    cqsz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    state->ringsz = sqsz > cqsz ? sqsz : cqsz;
+    ring = mmap(NULL,state->ringsz,PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) goto err;
+    state->ring = ring;
+
+    state->sqesz = p.sq_entries*sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL,state->sqesz,PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) {
+        state->sqes = NULL;
+        goto err;
+    }
+
+    state->sqhead = (unsigned *)(ring + p.sq_off.head);
+    state->sqtail = (unsigned *)(ring + p.sq_off.tail);
+    state->sqmask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    state->sqentries = p.sq_entries;
+    state->sqlocal = *state->sqtail;
+    state->cqhead = (unsigned *)(ring + p.cq_off.head);
+    state->cqtail = (unsigned *)(ring + p.cq_off.tail);
+    state->cqmask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    /* SQEs are always used in ring order. */
+    for (i = 0; i < p.sq_entries; i++)
+        ((unsigned *)(ring + p.sq_off.array))[i] = i;
+
+    state->fds = zmalloc(sizeof(aeUringFd)*eventLoop->setsize);
+    state->rearm = zmalloc(sizeof(int)*eventLoop->setsize);
+    state->ready = zmalloc(sizeof(int)*eventLoop->setsize);
+    if (!state->fds || !state->rearm || !state->ready) goto err;
+    aeUringInitFds(state,0,eventLoop->setsize);
+    aeUringSetupRecv(eventLoop);
+    return 0;
+
+err:
+    aeUringFree(eventLoop);
+    eventLoop->apidata = NULL;
+    return -1;
+}
+
+static int aeUringResize(aeEventLoop *eventLoop, int setsize) {
+    aeUringState *state = eventLoop->apidata;
+
+    state->fds = zrealloc(state->fds,sizeof(aeUringFd)*setsize);
+    state->rearm = zrealloc(state->rearm,sizeof(int)*setsize);
+    state->ready = zrealloc(state->ready,sizeof(int)*setsize);
+    aeUringInitFds(state,eventLoop->setsize,setsize);
+    return 0;
+}
+
+static int aeUringAddEvent(aeEventLoop *eventLoop, int slot, int mask) {
+    aeUringUpdate(eventLoop,slot,aeFileEventAt(eventLoop,slot)->mask | mask);
+    return 0;
+}
+
+static void aeUringDelEvent(aeEventLoop *eventLoop, int slot, int delmask) {
+    aeUringUpdate(eventLoop,slot,
+            aeFileEventAt(eventLoop,slot)->mask & (~delmask));
+}
+
+/* Queue the data or end of a completed recv on its slot. */
+static void aeUringReceived(aeEventLoop *eventLoop, struct io_uring_cqe *cqe) {
+    aeUringState *state = eventLoop->apidata;
+    unsigned long long data = cqe->user_data;
+    int slot = (int)(data & AE_URING_SLOT), bid = -1;
+    aeUringFd *f = slot < eventLoop->setsize ? &state->fds[slot] : NULL;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    /* Completions of a cancelled recv still hand over a buffer. */
+    if (!f || !f->receiving || f->recvGen != (unsigned int)(data >> 32)) {
+        if (bid != -1) aeUringRecycle(state,bid);
+        return;
+    }
+
+    if (cqe->res > 0 && bid != -1) {
+        state->lens[bid] = cqe->res;
+        state->next[bid] = -1;
+        if (f->tail == -1) f->head = bid;
+        else state->next[f->tail] = bid;
+        f->tail = bid;
+    } else if (bid != -1) {
+        aeUringRecycle(state,bid);
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        f->receiving = 0;
+        if (cqe->res == -EINVAL) {
+            /* No multishot recv in this kernel, poll and read() instead. */
+            state->recv = 0;
+        } else if (cqe->res == 0) {
+            f->end = 1;
+        } else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+            f->end = cqe->res;
+        }
+        /* Ran out of buffers or the kernel ended it, receive again. */
+        if (!f->end) aeUringMarkDirty(state,slot);
+    }
+
+    if ((f->head != -1 || f->end) && !f->ready) {
+        f->ready = 1;
+        state->ready[state->readyCount++] = slot;
+    }
+}
+
+/* Copy out the data received for a slot, recycling the buffers emptied. */
+static ssize_t aeUringRead(aeEventLoop *eventLoop, int slot, void *buf,
+        size_t len) {
+    aeUringState *state = eventLoop->apidata;
+    aeUringFd *f = &state->fds[slot];
+    size_t n = 0;
+
+    if (!state->recv) {
+        eventLoop->syscalls++;
+        return read(aeFileEventAt(eventLoop,slot)->fd,buf,len);
+    }
+    while (n < len && f->head != -1) {
+        int bid = f->head;
+        size_t avail = state->lens[bid] - f->offset;
+        size_t take = avail < len - n ? avail : len - n;
+
+        memcpy((char *)buf + n,
+               state->bufs + (size_t)bid*AE_URING_BUF_SIZE + f->offset,take);
+        n += take;
+        f->offset += take;
+        if (f->offset == state->lens[bid]) {
+            f->head = state->next[bid];
+            if (f->head == -1) f->tail = -1;
+            f->offset = 0;
+            aeUringRecycle(state,bid);
+        }
+    }
+    if (n) return n;
+    if (f->end == 1) return 0;
+    errno = f->end ? -f->end : EAGAIN;
+    return -1;
+}
+
+static int aeUringPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeUringState *state = eventLoop->apidata;
+    struct __kernel_timespec ts, *tsp = NULL;
+    unsigned head, tail, wait = 1;
+    int j, numevents = 0;
+
+    for (j = 0; j < state->rearmCount; j++) {
+        int slot = state->rearm[j], recv, poll;
+        aeFileEvent *fe = aeFileEventAt(eventLoop,slot);
+        aeUringFd *f = &state->fds[slot];
+
+        f->dirty = 0;
+        poll = aeUringWants(state,fe->mask,&recv);
+        if (f->armed == AE_NONE && poll != AE_NONE)
+            aeUringArm(state,slot,fe->fd,poll);
+        if (recv && !f->receiving && !f->end)
+            aeUringArmRecv(state,slot,fe->fd);
+    }
+    state->rearmCount = 0;
+
+    /* Slots stay ready until their data is read, like a level-triggered
+     * poll, and while ready ones remain nothing is waited for. */
+    for (j = 0; j < state->readyCount; ) {
+        aeUringFd *f = &state->fds[state->ready[j]];
+
+        if (f->head == -1 && !f->end) {
+            f->ready = 0;
+            state->ready[j] = state->ready[--state->readyCount];
+        } else {
+            j++;
+        }
+    }
+    if (state->readyCount) wait = 0;
+
+    if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec * 1000;
+        tsp = &ts;
+        if (tvp->tv_sec == 0 && tvp->tv_usec == 0) wait = 0;
+    }
+    if (*state->cqhead != __atomic_load_n(state->cqtail,__ATOMIC_ACQUIRE))
+        wait = 0;
+    aeUringSubmit(state,wait,tsp);
+
+    head = *state->cqhead;
+    tail = __atomic_load_n(state->cqtail,__ATOMIC_ACQUIRE);
+    /* Stop once fired[] would be full with the ready slots: cqhead is only
+     * advanced past the completions consumed, the rest stay in the queue
+     * and the next call returns them without waiting, nothing is dropped. */
+    while (head != tail && numevents + state->readyCount < eventLoop->setsize) {
+        struct io_uring_cqe *cqe = &state->cqes[head++ & state->cqmask];
+        unsigned long long data = cqe->user_data;
+        int slot = (int)(data & AE_URING_SLOT), mask = 0;
+        aeUringFd *f;
+
+        if (data == AE_URING_IGNORE) continue;
+        if (data & AE_URING_RECV) {
+            aeUringReceived(eventLoop,cqe);
+            continue;
+        }
+        if (slot >= eventLoop->setsize) continue;
+        f = &state->fds[slot];
+        /* Completions of cancelled or replaced polls are stale. */
+        if (f->gen != (unsigned int)(data >> 32) || f->armed == AE_NONE)
+            continue;
+
+        f->armed = AE_NONE;
+        aeUringMarkDirty(state,slot);
+        if (cqe->res < 0) continue;
+
+        if (cqe->res & POLLIN) mask |= AE_READABLE;
+        if (cqe->res & POLLOUT) mask |= AE_WRITABLE;
+        if (cqe->res & POLLERR) mask |= AE_WRITABLE;
+        if (cqe->res & POLLHUP) mask |= AE_WRITABLE;
+        eventLoop->fired[numevents].slot = slot;
+        eventLoop->fired[numevents].mask = mask;
+        numevents++;
+    }
+    __atomic_store_n(state->cqhead,head,__ATOMIC_RELEASE);
+    for (j = 0; j < state->readyCount; j++) {
+        eventLoop->fired[numevents].slot = state->ready[j];
+        eventLoop->fired[numevents].mask = AE_READABLE;
+        numevents++;
+    }
+    eventLoop->syscalls += state->syscalls;
+    state->syscalls = 0;
+    return numevents;
+}
+
+static char *aeUringName(void) {
+    return "io_uring";
+}
@@ -72,31 +72,37 @@ static void aeApiFree(aeEventLoop *eventLoop) {
     zfree(state);
 }
 
-static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static int aeApiAddEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
+    int fd = aeFileEventAt(eventLoop,slot)->fd;
     struct kevent ke;
 
     if (mask & AE_READABLE) {
         EV_SET(&ke, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+        eventLoop->syscalls++;
         if (kevent(state->kqfd, &ke, 1, NULL, 0, NULL) == -1) return -1;
     }
     if (mask & AE_WRITABLE) {
         EV_SET(&ke, fd, EVFILT_WRITE, EV_ADD, 0, 0, NULL);
+        eventLoop->syscalls++;
         if (kevent(state->kqfd, &ke, 1, NULL, 0, NULL) == -1) return -1;
     }
     return 0;
 }
 
-static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static void aeApiDelEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
+    int fd = aeFileEventAt(eventLoop,slot)->fd;
     struct kevent ke;
 
     if (mask & AE_READABLE) {
         EV_SET(&ke, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        eventLoop->syscalls++;
         kevent(state->kqfd, &ke, 1, NULL, 0, NULL);
     }
     if (mask & AE_WRITABLE) {
         EV_SET(&ke, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+        eventLoop->syscalls++;
         kevent(state->kqfd, &ke, 1, NULL, 0, NULL);
     }
 }
@@ -105,6 +111,7 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
     aeApiState *state = eventLoop->apidata;
     int retval, numevents = 0;
 
+    eventLoop->syscalls++;
     if (tvp != NULL) {
         struct timespec timeout;
         timeout.tv_sec = tvp->tv_sec;
@@ -119,15 +126,16 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
     if (retval > 0) {
         int j;
 
-        numevents = retval;
-        for(j = 0; j < numevents; j++) {
-            int mask = 0;
+        for(j = 0; j < retval; j++) {
+            int mask = 0, slot;
             struct kevent *e = state->events+j;
 
+            if ((slot = aeFdSlotFind(eventLoop,e->ident)) == -1) continue;
             if (e->filter == EVFILT_READ) mask |= AE_READABLE;
             if (e->filter == EVFILT_WRITE) mask |= AE_WRITABLE;
-            eventLoop->fired[j].fd = e->ident;
-            eventLoop->fired[j].mask = mask;
+            eventLoop->fired[numevents].slot = slot;
+            eventLoop->fired[numevents].mask = mask;
+            numevents++;
         }
     }
     return numevents;
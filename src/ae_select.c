@@ -37,6 +37,7 @@ typedef struct aeApiState {
     /* We need to have a copy of the fd sets as it's not safe to reuse
      * FD sets after select(). */
     fd_set _rfds, _wfds;
+    int maxfd; /* highest fd in the sets, -1 if none */
 } aeApiState;
 
 static int aeApiCreate(aeEventLoop *eventLoop) {
@@ -45,13 +46,14 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     if (!state) return -1;
     FD_ZERO(&state->rfds);
     FD_ZERO(&state->wfds);
+    state->maxfd = -1;
     eventLoop->apidata = state;
     return 0;
 }
 
 static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
-    /* Just ensure we have enough room in the fd_set type. */
-    if (setsize >= FD_SETSIZE) return -1;
+    /* Nothing to resize here, fds are checked against FD_SETSIZE as they
+     * are added. */
     return 0;
 }
 
@@ -59,19 +61,31 @@ static void aeApiFree(aeEventLoop *eventLoop) {
     zfree(eventLoop->apidata);
 }
 
-static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static int aeApiAddEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
+    int fd = aeFileEventAt(eventLoop,slot)->fd;
 
+    if (fd >= FD_SETSIZE) {
+        errno = ERANGE;
+        return -1;
+    }
     if (mask & AE_READABLE) FD_SET(fd,&state->rfds);
     if (mask & AE_WRITABLE) FD_SET(fd,&state->wfds);
+    if (fd > state->maxfd) state->maxfd = fd;
     return 0;
 }
 
-static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static void aeApiDelEvent(aeEventLoop *eventLoop, int slot, int mask) {
     aeApiState *state = eventLoop->apidata;
+    int fd = aeFileEventAt(eventLoop,slot)->fd;
 
     if (mask & AE_READABLE) FD_CLR(fd,&state->rfds);
     if (mask & AE_WRITABLE) FD_CLR(fd,&state->wfds);
+    /* Update the max fd */
+    while (state->maxfd >= 0 &&
+           !FD_ISSET(state->maxfd,&state->rfds) &&
+           !FD_ISSET(state->maxfd,&state->wfds))
+        state->maxfd--;
 }
 
 static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
@@ -81,19 +95,18 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
     memcpy(&state->_rfds,&state->rfds,sizeof(fd_set));
     memcpy(&state->_wfds,&state->wfds,sizeof(fd_set));
 
-    retval = select(eventLoop->maxfd+1,
+    eventLoop->syscalls++;
+    retval = select(state->maxfd+1,
                 &state->_rfds,&state->_wfds,NULL,tvp);
     if (retval > 0) {
-        for (j = 0; j <= eventLoop->maxfd; j++) {
-            int mask = 0;
-            aeFileEvent *fe = &eventLoop->events[j];
-
-            if (fe->mask == AE_NONE) continue;
-            if (fe->mask & AE_READABLE && FD_ISSET(j,&state->_rfds))
-                mask |= AE_READABLE;
-            if (fe->mask & AE_WRITABLE && FD_ISSET(j,&state->_wfds))
-                mask |= AE_WRITABLE;
-            eventLoop->fired[numevents].fd = j;
+        for (j = 0; j <= state->maxfd; j++) {
+            int mask = 0, slot;
+
+            if (FD_ISSET(j,&state->_rfds)) mask |= AE_READABLE;
+            if (FD_ISSET(j,&state->_wfds)) mask |= AE_WRITABLE;
+            if (mask == AE_NONE || (slot = aeFdSlotFind(eventLoop,j)) == -1)
+                continue;
+            eventLoop->fired[numevents].slot = slot;
             eventLoop->fired[numevents].mask = mask;
             numevents++;
         }
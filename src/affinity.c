@@ -0,0 +1,151 @@
+// CPU placement of the threads, see --affinity.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+#include "zmalloc.h"
+
+static void affinity_add(affinity *a, int cpu) {
+    a->cpus = zrealloc(a->cpus, (a->count + 1) * sizeof(int));
+    a->cpus[a->count++] = cpu;
+}
+
+#ifdef __linux__
+
+#define MAX_CPUS CPU_SETSIZE
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    int sibling; // hardware threads of the same core listed before it
+} placement;
+
+// -1 if the attribute cannot be read, e.g. without sysfs.
+static int cpu_topology(int cpu, const char *name) {
+    char path[128];
+    FILE *file;
+    int value = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    if ((file = fopen(path, "r")) != NULL) {
+        if (fscanf(file, "%d", &value) != 1) value = -1;
+        fclose(file);
+    }
+    return value;
+}
+
+// One thread per physical core before any core runs two, and the cores of a
+// package before those of the next so threads share a socket when they can.
+static int placement_cmp(const void *a, const void *b) {
+    const placement *x = a, *y = b;
+    if (x->sibling != y->sibling) return x->sibling - y->sibling;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core    != y->core)    return x->core    - y->core;
+    return x->cpu - y->cpu;
+}
+
+// Every CPU wrk may run on, in placement order.
+static int affinity_auto(affinity *a) {
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set)) return -1;
+
+    placement *p = zcalloc(CPU_COUNT(&set) * sizeof(placement));
+    int count = 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+
+        placement *q = &p[count];
+        q->cpu     = cpu;
+        q->package = cpu_topology(cpu, "physical_package_id");
+        q->core    = cpu_topology(cpu, "core_id");
+        if (q->core == -1) q->core = cpu;
+        for (int i = 0; i < count; i++) {
+            if (p[i].package == q->package && p[i].core == q->core) q->sibling++;
+        }
+        count++;
+    }
+
+    qsort(p, count, sizeof(placement), placement_cmp);
+    for (int i = 0; i < count; i++) {
+        affinity_add(a, p[i].cpu);
+    }
+    zfree(p);
+
+    return 0;
+}
+
+int affinity_pin(int cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+#else
+
+#define MAX_CPUS 0 // threads cannot be pinned
+
+static int affinity_auto(affinity *a) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+int affinity_pin(int cpu) {
+    return ENOTSUP;
+}
+
+#endif
+
+// "auto" or a list of CPUs and ranges of CPUs, e.g. 0-3,8,10-11.
+int affinity_parse(affinity *a, const char *spec) {
+    const char *s = spec;
+
+    a->count = 0;
+    if (!MAX_CPUS) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (!strcmp(spec, "auto")) return affinity_auto(a);
+
+    while (*s) {
+        char *end;
+        long first = strtol(s, &end, 10), last = first;
+
+        if (end == s || first < 0) goto invalid;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first) goto invalid;
+        }
+        if (last >= MAX_CPUS) goto invalid;
+        for (long cpu = first; cpu <= last; cpu++) {
+            affinity_add(a, cpu);
+        }
+
+        if (*end == ',' && end[1]) {
+            end++;
+        } else if (*end) {
+            goto invalid;
+        }
+        s = end;
+    }
+    if (a->count) return 0;
+
+  invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+int affinity_cpu(affinity *a, uint64_t i) {
+    return a->cpus[i % a->count];
+}
@@ -0,0 +1,16 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdint.h>
+
+// CPUs the threads are pinned to, thread i runs on cpus[i % count].
+typedef struct {
+    int *cpus;
+    int count;
+} affinity;
+
+int affinity_parse(affinity *, const char *);
+int affinity_cpu(affinity *, uint64_t);
+int affinity_pin(int);
+
+#endif /* AFFINITY_H */
@@ -5,6 +5,15 @@
 #define HAVE_KQUEUE
 #elif defined(__linux__)
 #define HAVE_EPOLL
+#include <features.h>
+#if defined(__GLIBC__) && ((__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35) || __GLIBC__ > 2)
+#define HAVE_EPOLL_PWAIT2
+#endif
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
 #elif defined (__sun)
 #define HAVE_EVPORT
 #define _XPG6
@@ -0,0 +1,160 @@
+// HdrHistogram V2 encoding and interval log writer.
+//
+// stats uses the same bucket layout as an HdrHistogram with a lowest
+// discernible value of 1, so bucket counts can be written out as-is and
+// decoded by any HdrHistogram implementation.
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "hdr.h"
+#include "zmalloc.h"
+
+#define V2_ENCODING_COOKIE    (0x1c849303 | 0x10)
+#define V2_COMPRESSION_COOKIE (0x1c849304 | 0x10)
+#define V2_HEADER_SIZE        40
+#define ZLIB_BLOCK_SIZE       65535
+
+static uint8_t *put_be32(uint8_t *p, uint32_t v) {
+    for (int i = 3; i >= 0; i--) *p++ = v >> (i * 8);
+    return p;
+}
+
+static uint8_t *put_be64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) *p++ = v >> (i * 8);
+    return p;
+}
+
+// ZigZag LEB128 with at most 9 bytes, the last one carrying a full 8 bits.
+static uint8_t *put_varint(uint8_t *p, int64_t value) {
+    uint64_t v = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    for (int i = 0; i < 8; i++) {
+        if (v >> 7 == 0) {
+            *p++ = v;
+            return p;
+        }
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+// Wrap data in a zlib stream made of stored (uncompressed) deflate blocks,
+// which every inflater accepts and which needs no compression library.
+static uint8_t *put_zlib(uint8_t *p, uint8_t *data, size_t len) {
+    uint32_t a = 1, b = 0;
+
+    *p++ = 0x78;
+    *p++ = 0x01;
+    do {
+        size_t n = len < ZLIB_BLOCK_SIZE ? len : ZLIB_BLOCK_SIZE;
+        *p++ = n == len;
+        *p++ = n & 0xff;
+        *p++ = n >> 8;
+        *p++ = ~n & 0xff;
+        *p++ = (~n >> 8) & 0xff;
+        for (size_t i = 0; i < n; i++) {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        memcpy(p, data, n);
+        p    += n;
+        data += n;
+        len  -= n;
+    } while (len);
+
+    return put_be32(p, (b << 16) | a);
+}
+
+static char *base64(uint8_t *data, size_t len) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *out = zmalloc((len + 2) / 3 * 4 + 1), *p = out;
+
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < len) v |= data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        *p++ = alphabet[(v >> 18) & 0x3f];
+        *p++ = alphabet[(v >> 12) & 0x3f];
+        *p++ = i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=';
+        *p++ = i + 2 < len ? alphabet[v & 0x3f] : '=';
+    }
+    *p = '\0';
+
+    return out;
+}
+
+char *hdr_encode(stats *stats) {
+    uint32_t last = stats->size;
+    while (last > 0 && stats->data[last - 1] == 0) last--;
+
+    size_t size = V2_HEADER_SIZE + last * 9;
+    uint8_t *raw = zmalloc(size);
+    uint8_t *p = raw + V2_HEADER_SIZE;
+
+    for (uint32_t i = 0; i < last; ) {
+        int64_t count = stats->data[i++];
+        if (count == 0) {
+            int64_t zeros = 1;
+            while (i < last && stats->data[i] == 0) zeros++, i++;
+            p = put_varint(p, zeros > 1 ? -zeros : 0);
+        } else {
+            p = put_varint(p, count);
+        }
+    }
+
+    size_t payload = p - raw - V2_HEADER_SIZE;
+    double ratio = 1.0;
+    uint64_t bits;
+    memcpy(&bits, &ratio, sizeof(bits));
+
+    p = put_be32(raw, V2_ENCODING_COOKIE);
+    p = put_be32(p, payload);
+    p = put_be32(p, 0);
+    p = put_be32(p, stats->digits);
+    p = put_be64(p, 1);
+    p = put_be64(p, stats->limit - 1);
+    p = put_be64(p, bits);
+
+    size_t len = V2_HEADER_SIZE + payload;
+    size_t blocks = len / ZLIB_BLOCK_SIZE + 1;
+    uint8_t *compressed = zmalloc(8 + 2 + blocks * 5 + len + 4);
+
+    p = put_zlib(compressed + 8, raw, len);
+    size_t zlen = p - compressed - 8;
+    put_be32(put_be32(compressed, V2_COMPRESSION_COOKIE), zlen);
+
+    char *encoded = base64(compressed, zlen + 8);
+    zfree(compressed);
+    zfree(raw);
+
+    return encoded;
+}
+
+void hdr_log_header(FILE *log) {
+    struct timeval now;
+    char date[64];
+
+    gettimeofday(&now, NULL);
+    strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Z %Y", localtime(&now.tv_sec));
+    fprintf(log, "#[Histogram log format version 1.3]\n");
+    fprintf(log, "#[StartTime: %ld.%03ld (seconds since epoch), %s]\n",
+            (long) now.tv_sec, (long) now.tv_usec / 1000, date);
+    fprintf(log, "\"StartTimestamp\",\"Interval_Length\",\"Interval_Max\",\"Interval_Compressed_Histogram\"\n");
+    fflush(log);
+}
+
+// Interval start and length are in microseconds relative to the log start,
+// the interval max is written in milliseconds.
+void hdr_log_interval(FILE *log, stats *stats, uint64_t start, uint64_t length) {
+    char *encoded = hdr_encode(stats);
+    fprintf(log, "%.3f,%.3f,%.3f,%s\n", start / 1000000.0, length / 1000000.0,
+            stats->count ? stats->max / 1000.0 : 0.0, encoded);
+    fflush(log);
+    zfree(encoded);
+}
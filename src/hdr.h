@@ -0,0 +1,12 @@
+#ifndef HDR_H
+#define HDR_H
+
+#include <stdio.h>
+#include "stats.h"
+
+char *hdr_encode(stats *);
+
+void hdr_log_header(FILE *);
+void hdr_log_interval(FILE *, stats *, uint64_t, uint64_t);
+
+#endif /* HDR_H */
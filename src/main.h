@@ -16,11 +16,16 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/uio.h>
+#include <sys/wait.h>
 
+#include "affinity.h"
 #include "ssl.h"
 #include "aprintf.h"
+#include "hdr.h"
 #include "stats.h"
 #include "units.h"
 #include "zmalloc.h"
@@ -28,10 +33,22 @@
 struct config;
 
 static void *thread_main(void *);
+static void thread_alloc(thread *);
 static int connect_socket(thread *, connection *);
 static int reconnect_socket(thread *, connection *);
+static int retry_connect(aeEventLoop *, long long, void *);
+static void socket_timeout(aeEventLoop *, void *);
+static void record_error(thread *, connection *);
+static void count_ssl_error(error_count *, unsigned long, uint32_t);
 
 static int record_rate(aeEventLoop *, long long, void *);
+static long long schedule_at(aeEventLoop *, uint64_t, aeTimeProc *, void *);
+static int generate_arrivals(aeEventLoop *, long long, void *);
+static void start_arrivals(thread *);
+static void dispatch_arrivals(thread *);
+static void connection_ready(thread *, connection *);
+static void publish_interval(thread *);
+static void report_intervals(thread *, uint64_t);
 
 static int warmup_timed_out(aeEventLoop *loop, long long id, void *data);
 
@@ -45,12 +62,31 @@ static int header_value(http_parser *, const char *, size_t);
 static int response_body(http_parser *, const char *, size_t);
 
 static uint64_t time_us();
+static void raise_nofile_limit(uint64_t);
+
+static void lock_memory();
+static worker *spawn_workers(uint64_t *);
+static bool wait_workers();
+static void worker_export(worker *);
+static void worker_merge(worker *);
+static void errors_add(errors *, errors *);
 
 static int parse_args(struct config *, char **, struct http_parser_url *, char **, int, char **);
 char *copy_url_part(const char *, struct http_parser_url *, enum http_parser_url_fields);
 
 static void print_stats_header();
 static void print_stats(char *, stats *, char *(*)(long double));
-static void print_stats_latency(stats *);
+static void print_stats_latency(char *, stats *);
+static void print_status_codes();
+static void print_error_causes();
+static const char *errno_name(int);
+static const char *ssl_error_name(unsigned long);
+static void print_tags();
+static void print_json_string(const char *);
+static void merge_tag(tag *);
+static void print_json(uint64_t, uint64_t, uint64_t, uint64_t, size_t, errors *);
+static void print_json_stats(char *, stats *);
+static void print_interval_header();
+static void print_interval(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, stats *);
 
 #endif /* MAIN_H */
@@ -0,0 +1,76 @@
+// Monotonic microsecond clock.
+//
+// clock_gettime(CLOCK_MONOTONIC) is used by default, on Linux it is served
+// from the vDSO without a system call. Building with -DUSE_PROCESSOR_CLOCK
+// on x86-64 reads the TSC directly instead, when the CPU reports a TSC
+// that runs at a constant rate through frequency and sleep state changes,
+// calibrated against the POSIX clock at startup.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "monotonic.h"
+
+static monotime getMonotonicUs_posix(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+monotime (*getMonotonicUs)(void) = getMonotonicUs_posix;
+
+#if defined(USE_PROCESSOR_CLOCK) && defined(__x86_64__) && defined(__linux__)
+
+#define TSC_CALIBRATION_US 20000
+
+// Microseconds per TSC tick as a 32.32 fixed point multiplier.
+static uint64_t tsc_multiplier;
+
+static monotime getMonotonicUs_tsc(void) {
+    return (monotime) (((unsigned __int128) __builtin_ia32_rdtsc() * tsc_multiplier) >> 32);
+}
+
+static int tsc_is_invariant(void) {
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    char line[4096];
+    int invariant = 0;
+
+    if (!cpuinfo) return 0;
+    while (fgets(line, sizeof(line), cpuinfo)) {
+        if (!strncmp(line, "flags", 5)) {
+            invariant = strstr(line, " constant_tsc") && strstr(line, " nonstop_tsc");
+            break;
+        }
+    }
+    fclose(cpuinfo);
+    return invariant;
+}
+
+static const char *monotonicInit_tsc(void) {
+    static char description[64];
+
+    if (!tsc_is_invariant()) return NULL;
+
+    monotime start = getMonotonicUs_posix(), end;
+    uint64_t ticks = __builtin_ia32_rdtsc();
+    while ((end = getMonotonicUs_posix()) - start < TSC_CALIBRATION_US);
+    ticks = __builtin_ia32_rdtsc() - ticks;
+
+    tsc_multiplier = ((end - start) << 32) / ticks;
+    getMonotonicUs = getMonotonicUs_tsc;
+
+    snprintf(description, sizeof(description), "X86 TSC @ %lu ticks/us",
+             (unsigned long) (ticks / (end - start)));
+    return description;
+}
+
+#endif
+
+const char *monotonicInit(void) {
+#if defined(USE_PROCESSOR_CLOCK) && defined(__x86_64__) && defined(__linux__)
+    const char *description = monotonicInit_tsc();
+    if (description) return description;
+#endif
+    return "POSIX clock_gettime";
+}
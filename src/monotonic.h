@@ -0,0 +1,14 @@
+#ifndef MONOTONIC_H
+#define MONOTONIC_H
+
+#include <stdint.h>
+
+// Microseconds since an arbitrary point, unaffected by changes to the
+// system clock, so only differences between readings are meaningful.
+typedef uint64_t monotime;
+
+extern monotime (*getMonotonicUs)(void);
+
+const char *monotonicInit(void);
+
+#endif /* MONOTONIC_H */
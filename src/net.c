@@ -2,11 +2,19 @@
 
 #include <errno.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
+#include <sys/socket.h>
 
 #include "net.h"
 
 status sock_connect(connection *c, char *host, int *retry_flags) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    c->thread->syscalls++;
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) error = errno;
+    if (error) {
+        c->cold->error = error;
+        return ERROR;
+    }
     return OK;
 }
 
@@ -14,26 +22,32 @@ status sock_close(connection *c) {
     return OK;
 }
 
-status sock_read(connection *c, size_t *n) {
-    ssize_t r = read(c->fd, c->buf, sizeof(c->buf));
+status sock_read(connection *c, char *buf, size_t len, size_t *n) {
+    // Counted by the event loop when it makes a system call.
+    ssize_t r = aeRead(c->thread->loop, c->fd, buf, len);
+    if (r == -1) {
+        switch (errno) {
+            case EAGAIN: return RETRY;
+            default:
+                c->cold->error = errno;
+                return ERROR;
+        }
+    }
     *n = (size_t) r;
-    return r >= 0 ? OK : ERROR;
+    return OK;
 }
 
 status sock_write(connection *c, char *buf, size_t len, size_t *n) {
     ssize_t r;
+    c->thread->syscalls++;
     if ((r = write(c->fd, buf, len)) == -1) {
         switch (errno) {
             case EAGAIN: return RETRY;
-            default:     return ERROR;
+            default:
+                c->cold->error = errno;
+                return ERROR;
         }
     }
     *n = (size_t) r;
     return OK;
 }
-
-size_t sock_readable(connection *c) {
-    int n, rc;
-    rc = ioctl(c->fd, FIONREAD, &n);
-    return rc == -1 ? 0 : n;
-}
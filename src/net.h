@@ -18,15 +18,13 @@ typedef enum {
 struct sock {
     status ( *connect)(connection *, char *, int *);
     status (   *close)(connection *);
-    status (    *read)(connection *, size_t *);
+    status (    *read)(connection *, char *, size_t, size_t *);
     status (   *write)(connection *, char *, size_t, size_t *);
-    size_t (*readable)(connection *);
 };
 
 status sock_connect(connection *, char *, int *);
 status sock_close(connection *);
-status sock_read(connection *, size_t *);
+status sock_read(connection *, char *, size_t, size_t *);
 status sock_write(connection *, char *, size_t, size_t *);
-size_t sock_readable(connection *);
 
 #endif /* NET_H */
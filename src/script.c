@@ -142,27 +142,36 @@ void script_init(lua_State *L, thread *t, int argc, char **argv) {
     lua_pop(t->L, 1);
 }
 
+// Delay in microseconds, delay() returns possibly fractional milliseconds.
 uint64_t script_delay(lua_State *L) {
     lua_getglobal(L, "delay");
     lua_call(L, 0, 1);
-    uint64_t delay = lua_tonumber(L, -1);
+    lua_Number ms = lua_tonumber(L, -1);
+    uint64_t delay = ms > 0 ? ms * 1000 : 0;
     lua_pop(L, 1);
     return delay;
 }
 
-void script_request(lua_State *L, char **buf, size_t *len) {
-    int pop = 1;
+// Returns the index + 1 of the tag request() returned as its second value,
+// 0 if there was none or no thread to record it against.
+uint32_t script_request(lua_State *L, thread *t, char **buf, size_t *len) {
+    uint32_t tag = 0;
+    int pop = 2;
     lua_getglobal(L, "request");
     if (!lua_isfunction(L, -1)) {
         lua_getglobal(L, "wrk");
         lua_getfield(L, -1, "request");
         pop += 2;
     }
-    lua_call(L, 0, 1);
-    const char *str = lua_tolstring(L, -1, len);
+    lua_call(L, 0, 2);
+    const char *str = lua_tolstring(L, -2, len);
     *buf = realloc(*buf, *len);
     memcpy(*buf, str, *len);
+    if (t && lua_type(L, -1) == LUA_TSTRING) {
+        tag = tag_lookup(t, lua_tostring(L, -1));
+    }
     lua_pop(L, pop);
+    return tag;
 }
 
 void script_response(lua_State *L, int status, buffer *headers, buffer *body) {
@@ -249,6 +258,28 @@ void script_push_stats(lua_State *L, stats *s) {
     lua_setmetatable(L, -2);
 }
 
+void script_tags(lua_State *L, tag *tags, uint32_t count) {
+    lua_newtable(L);
+    for (uint32_t i = 0; i < count; i++) {
+        const table_field fields[] = {
+            { "requests", LUA_TNUMBER, &tags[i].complete },
+            { "errors",   LUA_TNUMBER, &tags[i].errors   },
+            { NULL,       0,           NULL              },
+        };
+        lua_newtable(L);
+        set_fields(L, 3, fields);
+        script_push_stats(L, tags[i].latency);
+        lua_setfield(L, 3, "latency");
+        lua_setfield(L, 2, tags[i].name);
+    }
+    lua_setfield(L, 1, "tags");
+}
+
+void script_corrected(lua_State *L, stats *corrected) {
+    script_push_stats(L, corrected);
+    lua_setfield(L, 1, "corrected");
+}
+
 void script_done(lua_State *L, stats *latency, stats *requests) {
     lua_getglobal(L, "done");
     lua_pushvalue(L, 1);
@@ -274,7 +305,7 @@ size_t script_verify_request(lua_State *L) {
     char *request = NULL;
     size_t len, count = 0;
 
-    script_request(L, &request, &len);
+    script_request(L, NULL, &request, &len);
     http_parser_init(&parser, HTTP_REQUEST);
     parser.data = &count;
 
@@ -17,7 +17,7 @@ void script_done(lua_State *, stats *, stats *);
 
 void script_init(lua_State *, thread *, int, char **);
 uint64_t script_delay(lua_State *);
-void script_request(lua_State *, char **, size_t *);
+uint32_t script_request(lua_State *, thread *, char **, size_t *);
 void script_response(lua_State *, int, buffer *, buffer *);
 size_t script_verify_request(lua_State *L);
 
@@ -27,6 +27,8 @@ bool script_has_delay(lua_State *L);
 bool script_has_done(lua_State *L);
 void script_summary(lua_State *, uint64_t, uint64_t, uint64_t);
 void script_errors(lua_State *, errors *);
+void script_tags(lua_State *, tag *, uint32_t);
+void script_corrected(lua_State *, stats *);
 
 void script_copy_value(lua_State *, lua_State *, int);
 int script_parse_url(char *, struct http_parser_url *);
@@ -1,5 +1,6 @@
 // Copyright (C) 2013 - Will Glozer.  All rights reserved.
 
+#include <errno.h>
 #include <pthread.h>
 
 #include <openssl/evp.h>
@@ -25,12 +26,41 @@ SSL_CTX *ssl_init() {
     return ctx;
 }
 
+// Remember why an operation failed: the errno of a system call error, or
+// the code of the last error OpenSSL queued for a protocol failure.
+static status ssl_failed(connection *c, int error) {
+    switch (error) {
+        case SSL_ERROR_SYSCALL: c->cold->error = errno; break;
+        case SSL_ERROR_SSL:     c->cold->ssl_error = ERR_peek_last_error(); break;
+    }
+    ERR_clear_error();
+    return ERROR;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+// Count the read() and write() calls the socket BIO makes for a connection.
+static long ssl_count_syscalls(BIO *bio, int oper, const char *argp, size_t len,
+                               int argi, long argl, int ret, size_t *processed) {
+    if (oper == (BIO_CB_READ | BIO_CB_RETURN) || oper == (BIO_CB_WRITE | BIO_CB_RETURN)) {
+        connection *c = (connection *) BIO_get_callback_arg(bio);
+        c->thread->syscalls++;
+    }
+    return ret;
+}
+#endif
+
 status ssl_connect(connection *c, char *host, int *retry_flags) {
     int r;
-    SSL_set_fd(c->ssl, c->fd);
-    SSL_set_tlsext_host_name(c->ssl, host);
-    if ((r = SSL_connect(c->ssl)) != 1) {
-        switch (SSL_get_error(c->ssl, r)) {
+    SSL_set_fd(c->cold->ssl, c->fd);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    BIO *bio = SSL_get_rbio(c->cold->ssl);
+    BIO_set_callback_arg(bio, (char *) c);
+    BIO_set_callback_ex(bio, ssl_count_syscalls);
+#endif
+    SSL_set_tlsext_host_name(c->cold->ssl, host);
+    if ((r = SSL_connect(c->cold->ssl)) != 1) {
+        int error = SSL_get_error(c->cold->ssl, r);
+        switch (error) {
             case SSL_ERROR_WANT_READ:
                 *retry_flags = E_WANT_READ;
                 return RETRY;
@@ -38,25 +68,26 @@ status ssl_connect(connection *c, char *host, int *retry_flags) {
                 *retry_flags = E_WANT_WRITE;
                 return RETRY;
             default:
-                return ERROR;
+                return ssl_failed(c, error);
         }
     }
     return OK;
 }
 
 status ssl_close(connection *c) {
-    SSL_shutdown(c->ssl);
-    SSL_clear(c->ssl);
+    SSL_shutdown(c->cold->ssl);
+    SSL_clear(c->cold->ssl);
     return OK;
 }
 
-status ssl_read(connection *c, size_t *n) {
+status ssl_read(connection *c, char *buf, size_t len, size_t *n) {
     int r;
-    if ((r = SSL_read(c->ssl, c->buf, sizeof(c->buf))) <= 0) {
-        switch (SSL_get_error(c->ssl, r)) {
+    if ((r = SSL_read(c->cold->ssl, buf, len)) <= 0) {
+        int error = SSL_get_error(c->cold->ssl, r);
+        switch (error) {
             case SSL_ERROR_WANT_READ:  return RETRY;
             case SSL_ERROR_WANT_WRITE: return RETRY;
-            default:                   return ERROR;
+            default:                   return ssl_failed(c, error);
         }
     }
     *n = (size_t) r;
@@ -65,17 +96,14 @@ status ssl_read(connection *c, size_t *n) {
 
 status ssl_write(connection *c, char *buf, size_t len, size_t *n) {
     int r;
-    if ((r = SSL_write(c->ssl, buf, len)) <= 0) {
-        switch (SSL_get_error(c->ssl, r)) {
+    if ((r = SSL_write(c->cold->ssl, buf, len)) <= 0) {
+        int error = SSL_get_error(c->cold->ssl, r);
+        switch (error) {
             case SSL_ERROR_WANT_READ:  return RETRY;
             case SSL_ERROR_WANT_WRITE: return RETRY;
-            default:                   return ERROR;
+            default:                   return ssl_failed(c, error);
         }
     }
     *n = (size_t) r;
     return OK;
 }
-
-size_t ssl_readable(connection *c) {
-    return SSL_pending(c->ssl);
-}
@@ -7,8 +7,7 @@ SSL_CTX *ssl_init();
 
 status ssl_connect(connection *, char *, int *);
 status ssl_close(connection *);
-status ssl_read(connection *, size_t *);
+status ssl_read(connection *, char *, size_t, size_t *);
 status ssl_write(connection *, char *, size_t, size_t *);
-size_t ssl_readable(connection *);
 
 #endif /* SSL_H */
@@ -2,106 +2,333 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "stats.h"
 #include "zmalloc.h"
 
-stats *stats_alloc(uint64_t max) {
-    uint64_t limit = max + 1;
-    stats *s = zcalloc(sizeof(stats) + sizeof(uint64_t) * limit);
-    s->limit = limit;
-    s->min   = UINT64_MAX;
+static uint32_t stats_index(stats *stats, uint64_t n) {
+    if (n < (1ULL << stats->bits)) return n;
+    uint32_t shift = 63 - __builtin_clzll(n) - (stats->bits - 1);
+    return (shift << (stats->bits - 1)) + (n >> shift);
+}
+
+static uint64_t stats_lowest(stats *stats, uint32_t i) {
+    uint32_t shift = i >> (stats->bits - 1);
+    if (shift < 2) return i;
+    shift--;
+    return (uint64_t) (i - (shift << (stats->bits - 1))) << shift;
+}
+
+static uint64_t stats_width(stats *stats, uint32_t i) {
+    uint32_t shift = i >> (stats->bits - 1);
+    return shift < 2 ? 1 : 1ULL << (shift - 1);
+}
+
+static uint64_t stats_highest(stats *stats, uint32_t i) {
+    return stats_lowest(stats, i) + stats_width(stats, i) - 1;
+}
+
+static uint64_t stats_median(stats *stats, uint32_t i) {
+    return stats_lowest(stats, i) + (stats_width(stats, i) >> 1);
+}
+
+stats *stats_alloc(uint64_t max, int digits) {
+    digits = MIN(MAX(digits, STATS_MIN_DIGITS), STATS_MAX_DIGITS);
+
+    // Enough sub-buckets to resolve 2 * 10^digits exactly.
+    uint32_t bits = ceil(log2(2 * pow(10, digits)));
+
+    stats tmp = { .bits = bits };
+    uint32_t buckets = stats_index(&tmp, max) + 1;
+
+    stats *s = zcalloc(sizeof(stats));
+    s->limit   = max + 1;
+    s->min     = UINT64_MAX;
+    s->digits  = digits;
+    s->bits    = bits;
+    s->buckets = buckets;
     return s;
 }
 
+// Extend the bucket array to cover index i, doubling to amortize growth.
+static void stats_grow(stats *stats, uint32_t i) {
+    uint32_t size = MAX(stats->size, STATS_MIN_BUCKETS);
+    while (size <= i) size *= 2;
+    size = MIN(size, stats->buckets);
+
+    stats->data = zrealloc(stats->data, size * sizeof(uint64_t));
+    memset(&stats->data[stats->size], 0, (size - stats->size) * sizeof(uint64_t));
+    stats->size = size;
+}
+
+// Allocate every bucket up to the limit so recording never grows the array.
+void stats_reserve(stats *stats) {
+    if (stats->size < stats->buckets) stats_grow(stats, stats->buckets - 1);
+}
+
 void stats_free(stats *stats) {
+    if (stats->view) {
+        zfree(stats->view->bucket);
+        zfree(stats->view->cumulative);
+        zfree(stats->view);
+    }
+    zfree(stats->data);
     zfree(stats);
 }
 
+void stats_reset(stats *stats) {
+    if (stats->count) {
+        uint32_t first = stats_index(stats, stats->min);
+        uint32_t last  = stats_index(stats, stats->max);
+        memset(&stats->data[first], 0, (last - first + 1) * sizeof(uint64_t));
+    }
+    stats->count = 0;
+    stats->min   = UINT64_MAX;
+    stats->max   = 0;
+    if (stats->view) stats->view->count = UINT64_MAX;
+}
+
 int stats_record(stats *stats, uint64_t n) {
     if (n >= stats->limit) return 0;
-    __sync_fetch_and_add(&stats->data[n], 1);
-    __sync_fetch_and_add(&stats->count, 1);
-    uint64_t min = stats->min;
-    uint64_t max = stats->max;
-    while (n < min) min = __sync_val_compare_and_swap(&stats->min, min, n);
-    while (n > max) max = __sync_val_compare_and_swap(&stats->max, max, n);
+    uint32_t i = stats_index(stats, n);
+    if (i >= stats->size) stats_grow(stats, i);
+    stats->data[i]++;
+    stats->count++;
+    if (n < stats->min) stats->min = n;
+    if (n > stats->max) stats->max = n;
     return 1;
 }
 
-void stats_correct(stats *stats, int64_t expected) {
-    for (uint64_t n = expected * 2; n <= stats->max; n++) {
-        uint64_t count = stats->data[n];
-        int64_t m = (int64_t) n - expected;
-        while (count && m > expected) {
-            stats->data[m] += count;
-            stats->count += count;
-            m -= expected;
+void stats_merge(stats *dst, stats *src) {
+    if (src->count == 0) return;
+
+    uint32_t last = MIN(stats_index(src, src->max), dst->buckets - 1);
+    if (last >= dst->size) stats_grow(dst, last);
+    for (uint32_t i = stats_index(src, src->min); i <= last; i++) {
+        dst->data[i] += src->data[i];
+    }
+    dst->count += src->count;
+    dst->min = MIN(dst->min, src->min);
+    dst->max = MAX(dst->max, src->max);
+}
+
+// Layout written by stats_export(), followed by n buckets from first on.
+typedef struct {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint32_t first;
+    uint32_t n;
+} stats_export_header;
+
+// Upper bound of the bytes stats_export() writes for the histogram.
+size_t stats_export_size(stats *stats) {
+    return sizeof(stats_export_header) + stats->buckets * sizeof(uint64_t);
+}
+
+// Copy the non-empty range of buckets to buf, for stats_import() to merge
+// into a histogram of the same limit and digits, e.g. in another process.
+size_t stats_export(stats *stats, char *buf) {
+    stats_export_header header = {
+        .count = stats->count,
+        .min   = stats->min,
+        .max   = stats->max,
+    };
+
+    if (stats->count) {
+        header.first = stats_index(stats, stats->min);
+        header.n     = stats_index(stats, stats->max) - header.first + 1;
+    }
+    memcpy(buf, &header, sizeof(header));
+    // data is NULL until a value is recorded, then there is nothing to copy.
+    if (header.n) memcpy(buf + sizeof(header), &stats->data[header.first], header.n * sizeof(uint64_t));
+    return sizeof(header) + header.n * sizeof(uint64_t);
+}
+
+// Merge a histogram written by stats_export(), returns the bytes it took.
+size_t stats_import(stats *stats, const char *buf) {
+    stats_export_header header;
+    const char *data = buf + sizeof(header);
+
+    memcpy(&header, buf, sizeof(header));
+    if (header.count) {
+        uint32_t last = header.first + header.n - 1;
+        if (last >= stats->size) stats_grow(stats, last);
+        for (uint32_t i = 0; i < header.n; i++) {
+            uint64_t n;
+            memcpy(&n, data + i * sizeof(uint64_t), sizeof(uint64_t));
+            stats->data[header.first + i] += n;
         }
+        stats->count += header.count;
+        stats->min = MIN(stats->min, header.min);
+        stats->max = MAX(stats->max, header.max);
     }
+    return sizeof(header) + header.n * sizeof(uint64_t);
 }
 
-long double stats_mean(stats *stats) {
-    if (stats->count == 0) return 0.0;
+// Back-fill the samples a closed-loop client missed while it waited for a
+// response of the given value: value - step, value - 2 * step, ... down to
+// step. Samples sharing a bucket are added at once, so the cost is bounded
+// by the number of buckets spanned rather than by value / step.
+void stats_record_series(stats *stats, uint64_t value, uint64_t step) {
+    if (step == 0 || value < 2 * step || value >= stats->limit) return;
+
+    uint64_t next = value % step + step;
+    uint64_t last = value - step;
+    uint32_t top  = stats_index(stats, last);
 
-    uint64_t sum = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        sum += stats->data[i] * i;
+    if (top >= stats->size) stats_grow(stats, top);
+    if (next < stats->min) stats->min = next;
+    if (last > stats->max) stats->max = last;
+
+    while (next <= last) {
+        uint32_t i = stats_index(stats, next);
+        uint64_t n = (MIN(stats_highest(stats, i), last) - next) / step + 1;
+        stats->data[i] += n;
+        stats->count   += n;
+        next += n * step;
+    }
+}
+
+static stats_view *stats_view_get(stats *stats) {
+    stats_view *view = stats->view;
+
+    if (view && view->count == stats->count) return view;
+    if (!view) view = stats->view = zcalloc(sizeof(stats_view));
+
+    view->count = stats->count;
+    view->size  = 0;
+    view->mean  = 0.0;
+    view->stdev = 0.0;
+    if (stats->count == 0) return view;
+
+    uint32_t first = stats_index(stats, stats->min);
+    uint32_t last  = stats_index(stats, stats->max);
+    if (view->capacity < last - first + 1) {
+        view->capacity   = last - first + 1;
+        view->bucket     = zrealloc(view->bucket, view->capacity * sizeof(uint32_t));
+        view->cumulative = zrealloc(view->cumulative, view->capacity * sizeof(uint64_t));
+    }
+
+    // Chan et al. pairwise update, each bucket is a group of identical values.
+    uint64_t total = 0;
+    long double mean = 0.0, m2 = 0.0;
+    for (uint32_t i = first; i <= last; i++) {
+        uint64_t count = stats->data[i];
+        if (!count) continue;
+        long double delta = stats_median(stats, i) - mean;
+        total += count;
+        mean  += delta * count / total;
+        m2    += delta * count * (stats_median(stats, i) - mean);
+        view->bucket[view->size]     = i;
+        view->cumulative[view->size] = total;
+        view->size++;
     }
-    return sum / (long double) stats->count;
+
+    view->mean  = mean;
+    view->stdev = total > 1 ? sqrtl(m2 / (total - 1)) : 0.0;
+    return view;
+}
+
+// First non-empty bucket whose cumulative count reaches rank.
+static uint32_t stats_view_rank(stats_view *view, uint64_t rank) {
+    uint32_t lo = 0, hi = view->size - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (view->cumulative[mid] >= rank) hi = mid; else lo = mid + 1;
+    }
+    return lo;
+}
+
+// Number of non-empty buckets whose value is below n.
+static uint32_t stats_view_below(stats *stats, stats_view *view, long double n) {
+    uint32_t lo = 0, hi = view->size;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (stats_median(stats, view->bucket[mid]) < n) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+void stats_summarize(stats *stats, stats_summary *summary) {
+    stats_view *view = stats_view_get(stats);
+    summary->mean  = view->mean;
+    summary->stdev = view->stdev;
+    summary->within_stdev = stats_within_stdev(stats, view->mean, view->stdev, 1);
+}
+
+long double stats_mean(stats *stats) {
+    return stats_view_get(stats)->mean;
 }
 
 long double stats_stdev(stats *stats, long double mean) {
+    stats_view *view = stats_view_get(stats);
     long double sum = 0.0;
+
     if (stats->count < 2) return 0.0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (stats->data[i]) {
-            sum += powl(i - mean, 2) * stats->data[i];
-        }
+    if (mean == view->mean) return view->stdev;
+
+    uint64_t prev = 0;
+    for (uint32_t j = 0; j < view->size; j++) {
+        uint64_t count = view->cumulative[j] - prev;
+        sum += powl(stats_median(stats, view->bucket[j]) - mean, 2) * count;
+        prev = view->cumulative[j];
     }
     return sqrtl(sum / (stats->count - 1));
 }
 
 long double stats_within_stdev(stats *stats, long double mean, long double stdev, uint64_t n) {
+    stats_view *view = stats_view_get(stats);
     long double upper = mean + (stdev * n);
     long double lower = mean - (stdev * n);
-    uint64_t sum = 0;
 
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (i >= lower && i <= upper) {
-            sum += stats->data[i];
-        }
-    }
+    if (stats->count == 0) return 0.0;
+
+    // Buckets in [lower, upper] are those below the first one above upper.
+    uint32_t from = stats_view_below(stats, view, lower);
+    uint32_t to   = stats_view_below(stats, view, nextafterl(upper, INFINITY));
+    uint64_t below = from ? view->cumulative[from - 1] : 0;
+    uint64_t above = to   ? view->cumulative[to - 1]   : 0;
 
-    return (sum / (long double) stats->count) * 100;
+    return ((above - below) / (long double) stats->count) * 100;
 }
 
 uint64_t stats_percentile(stats *stats, long double p) {
     uint64_t rank = round((p / 100.0) * stats->count + 0.5);
-    uint64_t total = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        total += stats->data[i];
-        if (total >= rank) return i;
-    }
-    return 0;
+    if (stats->count == 0) return 0;
+    if (rank > stats->count) return stats->max;
+
+    stats_view *view = stats_view_get(stats);
+    uint32_t j = stats_view_rank(view, MAX(rank, 1));
+    return MIN(stats_highest(stats, view->bucket[j]), stats->max);
 }
 
 uint64_t stats_popcount(stats *stats) {
-    uint64_t count = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (stats->data[i]) count++;
-    }
-    return count;
+    return stats_view_get(stats)->size;
 }
 
 uint64_t stats_value_at(stats *stats, uint64_t index, uint64_t *count) {
+    stats_view *view = stats_view_get(stats);
     *count = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (stats->data[i] && (*count)++ == index) {
+    if (index >= view->size) return 0;
+    *count = view->cumulative[index] - (index ? view->cumulative[index - 1] : 0);
+    return stats_median(stats, view->bucket[index]);
+}
+
+// Iterate over non-empty buckets, *index must start at 0.
+bool stats_next(stats *stats, uint32_t *index, uint64_t *value, uint64_t *count) {
+    if (stats->count == 0) return false;
+    uint32_t last = stats_index(stats, stats->max);
+    for (uint32_t i = MAX(*index, stats_index(stats, stats->min)); i <= last; i++) {
+        if (stats->data[i]) {
+            *value = stats_median(stats, i);
             *count = stats->data[i];
-            return i;
+            *index = i + 1;
+            return true;
         }
     }
-    return 0;
+    *index = last + 1;
+    return false;
 }
@@ -2,11 +2,16 @@
 #define STATS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
 
+#define STATS_MIN_DIGITS 1
+#define STATS_MAX_DIGITS 3
+#define STATS_MIN_BUCKETS 64
+
 typedef struct {
     uint32_t connect;
     uint32_t read;
@@ -17,20 +22,56 @@ typedef struct {
     uint32_t reconnect;
 } errors;
 
+// Log-linear histogram: values below 2^bits are counted exactly, above that
+// each power of two is split into 2^(bits-1) equal sub-buckets, bounding the
+// relative error of any recorded value by the number of significant digits.
+// Buckets are allocated on demand up to the highest value recorded, so a
+// histogram costs memory in proportion to what it holds, not to its limit.
 typedef struct {
     uint64_t count;
     uint64_t limit;
     uint64_t min;
     uint64_t max;
-    uint64_t data[];
+    uint32_t digits;
+    uint32_t bits;
+    uint32_t buckets;
+    uint32_t size;
+    struct stats_view *view;
+    uint64_t *data;
 } stats;
 
-stats *stats_alloc(uint64_t);
+// Prefix sums over the non-empty buckets, built in a single pass by the
+// first query after the histogram changed and shared by all later ones.
+typedef struct stats_view {
+    uint64_t count;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t *bucket;
+    uint64_t *cumulative;
+    long double mean;
+    long double stdev;
+} stats_view;
+
+typedef struct {
+    long double mean;
+    long double stdev;
+    long double within_stdev;
+} stats_summary;
+
+stats *stats_alloc(uint64_t, int);
 void stats_free(stats *);
+void stats_reset(stats *);
+void stats_reserve(stats *);
 
 int stats_record(stats *, uint64_t);
-void stats_correct(stats *, int64_t);
+void stats_merge(stats *, stats *);
+void stats_record_series(stats *, uint64_t, uint64_t);
+
+size_t stats_export_size(stats *);
+size_t stats_export(stats *, char *);
+size_t stats_import(stats *, const char *);
 
+void stats_summarize(stats *, stats_summary *);
 long double stats_mean(stats *);
 long double stats_stdev(stats *stats, long double);
 long double stats_within_stdev(stats *, long double, long double, uint64_t);
@@ -38,5 +79,6 @@ uint64_t stats_percentile(stats *, long double);
 
 uint64_t stats_popcount(stats *);
 uint64_t stats_value_at(stats *stats, uint64_t, uint64_t *);
+bool stats_next(stats *, uint32_t *, uint64_t *, uint64_t *);
 
 #endif /* STATS_H */
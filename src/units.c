@@ -99,6 +99,10 @@ int scan_metric(char *s, uint64_t *n) {
     return scan_units(s, n, &metric_units);
 }
 
+int scan_binary(char *s, uint64_t *n) {
+    return scan_units(s, n, &binary_units);
+}
+
 int scan_time(char *s, uint64_t *n) {
     return scan_units(s, n, &time_units_s);
 }
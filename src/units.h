@@ -7,6 +7,7 @@ char *format_time_us(long double);
 char *format_time_s(long double);
 
 int scan_metric(char *, uint64_t *);
+int scan_binary(char *, uint64_t *);
 int scan_time(char *, uint64_t *);
 
 #endif /* UNITS_H */
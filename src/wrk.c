@@ -4,6 +4,12 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <net/if.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "wrk.h"
 #include "script.h"
@@ -13,12 +19,28 @@
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 #endif
 
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
 enum {
     PHASE_INIT = 0,
     PHASE_WARMUP,
     PHASE_NORMAL,
 };
 
+enum {
+    ARRIVAL_NONE = 0,
+    ARRIVAL_CONSTANT,
+    ARRIVAL_POISSON,
+};
+
+enum {
+    FORMAT_TEXT = 0,
+    FORMAT_CSV,
+    FORMAT_JSON,
+};
+
 static struct config {
     uint64_t connections;
     uint64_t duration;
@@ -26,43 +48,105 @@ static struct config {
     uint64_t timeout;
     uint64_t pipeline;
     uint64_t warmup_timeout;
+    uint64_t interval;
+    uint64_t rate;
+    uint64_t read_size;
+    uint64_t processes;
     uint16_t secondaries_num;
+    int      digits;
+    int      interval_format;
+    int      arrival;
+    int      output;
     bool     warmup;
     bool     delay;
     bool     dynamic;
+    bool     response;
     bool     latency;
+    bool     phases;
+    bool     mlock;
+    affinity affinity;
     char    *host;
     char    *script;
     char    *local_ip;
     char    *sync_ipport;
+    char    *hdr_log;
     SSL_CTX *ctx;
 } cfg;
 
 static struct {
     stats *latency;
     stats *requests;
+    stats *queue;
+    stats *corrected;
+    stats *success;
+    stats *failure;
+    stats *connect;
+    stats *handshake;
+    stats *ttfb;
+    stats *ttlb;
+    stats *slippage;
 } statistics;
 
+// Histograms a worker hands back to the parent, in this order.
+#define WORKER_STATISTICS {                                         \
+    statistics.latency, statistics.requests, statistics.queue,     \
+    statistics.corrected, statistics.success, statistics.failure,  \
+    statistics.slippage, statistics.connect, statistics.handshake, \
+    statistics.ttfb, statistics.ttlb,                              \
+}
+
+// Worker processes of --processes, each with a results slot of stride
+// bytes in memory shared with the parent.
+static struct {
+    pid_t *pids;
+    char *shared;
+    size_t stride;
+} workers;
+
+// Responses by status code, codes outside 0-599 are counted at 0.
+static uint64_t status_codes[MAX_STATUS];
+
+// Socket error causes of all threads, see record_error().
+static uint32_t causes[MAX_ERRNO];
+static error_count ssl_errors[MAX_SSL_ERRORS];
+
+// Per-tag results of all threads, merged by name after the run.
+static struct {
+    tag *list;
+    uint32_t count;
+} tags;
+
 static struct sock sock = {
     .connect  = sock_connect,
     .close    = sock_close,
     .read     = sock_read,
-    .write    = sock_write,
-    .readable = sock_readable
+    .write    = sock_write
 };
 
+// Events of a connected socket. The event loop may receive for plain TCP
+// sockets, sock_read() takes the data from it, but not for OpenSSL's.
+static int readable = AE_READABLE | AE_RECV;
+
 static struct http_parser_settings parser_settings = {
     .on_message_complete = response_complete
 };
 
 static volatile sig_atomic_t stop = 0;
 
+// Progress messages go to stderr when stdout carries machine-readable output.
+static FILE *console;
+static FILE *hdr_log;
+
 // XXX This is a hack not to pass parameter to the script module.
 char *g_local_ip = NULL;
 
 int g_ready_threads = 0;
 static volatile sig_atomic_t g_is_ready = 0;
 
+// Incremented by the main thread to ask every thread to publish its interval
+// counters and swap its interval histogram, see publish_interval().
+static uint64_t g_interval_epoch = 0;
+
 static void handler(int sig) {
     stop = 1;
 }
@@ -82,8 +166,23 @@ static void usage() {
            "                                                         \n"
            "    -s, --script         <S>  Load Lua script file       \n"
            "    -H, --header         <H>  Add header to request      \n"
+           "    -R, --rate           <N>  Constant throughput, req/sec\n"
+           "        --arrival        <A>  Open-loop arrivals at --rate:\n"
+           "                              constant or poisson        \n"
            "        --latency             Print latency statistics   \n"
+           "        --phases              Time connect, TLS, TTFB, TTLB\n"
            "        --timeout        <T>  Socket/request timeout     \n"
+           "        --precision      <N>  Histogram significant digits,\n"
+           "                              1-3, ~15KB or ~95KB each at 2 or 3\n"
+           "        --interval       <T>  Report statistics every interval\n"
+           "        --interval-format <F> Interval format: text, csv, json\n"
+           "        --output         <F>  Result format: text or json\n"
+           "        --hdr-log        <S>  Write HdrHistogram interval log\n"
+           "        --backend        <S>  Event loop backend, e.g. io_uring\n"
+           "        --read-size      <S>  Bytes per socket read, e.g. 256K\n"
+           "        --affinity       <S>  Pin threads to CPUs: auto or 0-3,8\n"
+           "        --mlock               Lock and prefault wrk's memory\n"
+           "        --processes      <N>  Split threads across N processes\n"
            "    -v, --version             Print version details      \n"
            "    -p, --primary        <P>  Number of secondary wrks   \n"
            "    -S, --sync     <ip:port>  Inter-wrk synch ip-port    \n"
@@ -111,6 +210,189 @@ static size_t csv_nr(const char *s) {
     return nr + 1;
 }
 
+// Every connection needs a socket, leave room for stdio, the event loops
+// and whatever the script or the TLS library open.
+static void raise_nofile_limit(uint64_t needed) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) || limit.rlim_cur >= needed) return;
+    limit.rlim_cur = limit.rlim_max >= needed ? needed : limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit)) getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < needed) {
+        fprintf(stderr, "warning: open files limited to %ju, %"PRIu64" needed, "
+                "raise the hard limit with ulimit -Hn\n", (uintmax_t) limit.rlim_cur, needed);
+    }
+}
+
+static void lock_memory() {
+#ifdef __GLIBC__
+    // Keep freed memory for reuse, returning it to the kernel means
+    // faulting it in again on the next allocation.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        fprintf(stderr, "warning: unable to lock memory: %s, "
+                "raise the limit with ulimit -l\n", strerror(errno));
+    }
+}
+
+// Fork cfg.processes workers that split the threads, connections and rate
+// between them. Results come back through an anonymous shared mapping made
+// before the fork, one slot per worker. Returns the worker's slot in the
+// worker, NULL in the parent. first is the index of the worker's first
+// thread across all workers.
+static worker *spawn_workers(uint64_t *first) {
+    stats *all[] = WORKER_STATISTICS;
+    // Room for MAX_WORKER_TAGS tags with names of 256 bytes on average.
+    size_t capacity = MAX_WORKER_TAGS * (sizeof(worker_tag) + 256 + stats_export_size(statistics.latency));
+
+    for (size_t i = 0; i < ARRAY_SIZE(all); i++) {
+        if (all[i]) capacity += stats_export_size(all[i]);
+    }
+    workers.stride = (sizeof(worker) + capacity + 63) & ~(size_t) 63;
+    workers.pids   = zcalloc(cfg.processes * sizeof(pid_t));
+    workers.shared = mmap(NULL, cfg.processes * workers.stride, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (workers.shared == MAP_FAILED) {
+        fprintf(stderr, "unable to map worker results: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    // Anything still buffered would be written again by every worker.
+    fflush(NULL);
+
+    uint64_t threads = cfg.threads;
+    for (uint64_t i = 0; i < cfg.processes; i++) {
+        uint64_t n = threads / cfg.processes + (i < threads % cfg.processes);
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            worker *w = (worker *) (workers.shared + i * workers.stride);
+            w->capacity     = capacity;
+            // Shares of the totals up to the last thread of this worker
+            // less those before its first, so the remainders add up.
+            uint64_t end = *first + n;
+            cfg.connections = cfg.connections * end / threads - cfg.connections * *first / threads;
+            cfg.rate        = cfg.rate ? MAX(cfg.rate * end / threads - cfg.rate * *first / threads, 1) : 0;
+            cfg.threads     = n;
+            // Memory locks are not inherited across fork.
+            if (cfg.mlock) lock_memory();
+            return w;
+        }
+        if (pid < 0) {
+            fprintf(stderr, "unable to create process %"PRIu64": %s\n", i, strerror(errno));
+            for (uint64_t j = 0; j < i; j++) kill(workers.pids[j], SIGKILL);
+            exit(2);
+        }
+        workers.pids[i] = pid;
+        *first += n;
+    }
+
+    return NULL;
+}
+
+// Wait for every worker to exit, interrupting the others as soon as one
+// fails or wrk itself is interrupted. Returns false if any worker failed.
+static bool wait_workers() {
+    uint64_t running = cfg.processes;
+    bool failed = false, interrupted = false;
+
+    while (running) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if (pid > 0) {
+            for (uint64_t i = 0; i < cfg.processes; i++) {
+                if (workers.pids[i] == pid) workers.pids[i] = 0;
+            }
+            failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+            running--;
+        } else if (errno != EINTR) {
+            break;
+        }
+
+        if ((failed || stop) && !interrupted) {
+            for (uint64_t i = 0; i < cfg.processes; i++) {
+                if (workers.pids[i]) kill(workers.pids[i], SIGINT);
+            }
+            interrupted = true;
+        }
+    }
+
+    return !failed;
+}
+
+// Leave what this worker's threads recorded, merged as usual, for the
+// parent. Tags past the capacity of the slot are left out.
+static void worker_export(worker *w) {
+    stats *all[] = WORKER_STATISTICS;
+    char *p = w->data, *end = w->data + w->capacity;
+
+    for (size_t i = 0; i < ARRAY_SIZE(all); i++) {
+        if (all[i]) p += stats_export(all[i], p);
+    }
+
+    for (uint32_t i = 0; i < tags.count; i++) {
+        tag *t = &tags.list[i];
+        worker_tag header = {
+            .complete = t->complete,
+            .errors   = t->errors,
+            .length   = strlen(t->name) + 1,
+        };
+
+        if (sizeof(header) + header.length + stats_export_size(t->latency) > (size_t) (end - p)) {
+            fprintf(stderr, "warning: too many tags, %s not reported\n", t->name);
+            continue;
+        }
+        memcpy(p, &header, sizeof(header));
+        memcpy(p + sizeof(header), t->name, header.length);
+        p += sizeof(header) + header.length;
+        p += stats_export(t->latency, p);
+        w->tags_count++;
+    }
+
+    memcpy(w->status, status_codes, sizeof(status_codes));
+    memcpy(w->causes, causes, sizeof(causes));
+    memcpy(w->ssl_errors, ssl_errors, sizeof(ssl_errors));
+}
+
+// Add the histograms, tags and error details of an exited worker to those
+// of this process, see worker_export().
+static void worker_merge(worker *w) {
+    stats *all[] = WORKER_STATISTICS;
+    const char *p = w->data;
+
+    for (size_t i = 0; i < ARRAY_SIZE(all); i++) {
+        if (all[i]) p += stats_import(all[i], p);
+    }
+
+    for (uint32_t i = 0; i < w->tags_count; i++) {
+        worker_tag header;
+        memcpy(&header, p, sizeof(header));
+
+        tag t = {
+            .name     = zstrdup(p + sizeof(header)),
+            .complete = header.complete,
+            .errors   = header.errors,
+            .latency  = stats_alloc(cfg.timeout * 1000, cfg.digits),
+        };
+        p += sizeof(header) + header.length;
+        p += stats_import(t.latency, p);
+        merge_tag(&t);
+    }
+
+    for (int code = 0; code < MAX_STATUS; code++) {
+        status_codes[code] += w->status[code];
+    }
+    for (int e = 0; e < MAX_ERRNO; e++) {
+        causes[e] += w->causes[e];
+    }
+    for (int j = 0; j < MAX_SSL_ERRORS && w->ssl_errors[j].count; j++) {
+        count_ssl_error(ssl_errors, w->ssl_errors[j].code, w->ssl_errors[j].count);
+    }
+}
+
 int main(int argc, char **argv) {
     char *url, **headers = zmalloc(argc * sizeof(char *));
     struct http_parser_url parts = {};
@@ -120,6 +402,8 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    monotonicInit();
+
     char *schema  = copy_url_part(url, &parts, UF_SCHEMA);
     char *host    = copy_url_part(url, &parts, UF_HOST);
     char *port    = copy_url_part(url, &parts, UF_PORT);
@@ -135,23 +419,46 @@ int main(int argc, char **argv) {
         sock.close    = ssl_close;
         sock.read     = ssl_read;
         sock.write    = ssl_write;
-        sock.readable = ssl_readable;
+        readable      = AE_READABLE;
     }
 
     signal(SIGPIPE, SIG_IGN);
+    raise_nofile_limit(cfg.connections + cfg.threads + 64);
 
-    statistics.latency  = stats_alloc(cfg.timeout * 1000);
-    statistics.requests = stats_alloc(MAX_THREAD_RATE_S);
+    if (cfg.mlock) lock_memory();
+
+    console = cfg.output == FORMAT_JSON ? stderr : stdout;
+    if (cfg.hdr_log) {
+        if ((hdr_log = fopen(cfg.hdr_log, "w")) == NULL) {
+            fprintf(stderr, "unable to open %s: %s\n", cfg.hdr_log, strerror(errno));
+            exit(1);
+        }
+        hdr_log_header(hdr_log);
+    }
+
+    statistics.latency  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    statistics.requests = stats_alloc(MAX_THREAD_RATE_S, cfg.digits);
+    statistics.queue    = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    statistics.corrected = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    statistics.success  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    statistics.failure  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    statistics.slippage = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    if (cfg.phases) {
+        statistics.connect   = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        statistics.handshake = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        statistics.ttfb      = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        statistics.ttlb      = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    }
     thread *threads     = zcalloc(cfg.threads * sizeof(thread));
 
-    fprintf(stdout, "Testing connect to %s:%s\n", host, service);
+    fprintf(console, "Testing connect to %s:%s\n", host, service);
     lua_State *L = script_create(cfg.script, url, headers);
     if (!script_resolve(L, host, service)) {
         char *msg = strerror(errno);
         fprintf(stderr, "unable to connect to %s:%s %s\n", host, service, msg);
         exit(1);
     }
-    fprintf(stdout, "Testing was successful\n");
+    fprintf(console, "Testing was successful\n");
 
     cfg.host = host;
 
@@ -183,14 +490,24 @@ int main(int argc, char **argv) {
             g_local_ip = local_ip_arr[0];
     }
 
-    for (uint64_t i = 0; i < cfg.threads; i++) {
+    // Index of the first thread of this process among all processes.
+    uint64_t first = 0;
+    worker *w = cfg.processes > 1 ? spawn_workers(&first) : NULL;
+    bool parent = cfg.processes > 1 && !w;
+    uint64_t running = parent ? 0 : cfg.threads;
+    uint64_t connections = 0;
+
+    // Heap allocated from here on is what the connections cost.
+    size_t heap = zmalloc_used_memory();
+
+    for (uint64_t i = 0; i < running; i++) {
         thread *t      = &threads[i];
-        // TODO Review whether we can reduce number of events per thread
-        t->loop        = aeCreateEventLoop(20 + cfg.connections * 3);
-        t->connections = cfg.connections / cfg.threads;
+        t->connections = cfg.connections / cfg.threads + (i < cfg.connections % cfg.threads);
+        connections   += t->connections;
+        t->cpu         = cfg.affinity.count ? affinity_cpu(&cfg.affinity, first + i) : -1;
 
         if (local_ip_nr > 0)
-            t->local_ip = local_ip_arr[i % local_ip_nr];
+            t->local_ip = local_ip_arr[(first + i) % local_ip_nr];
 
         t->L = script_create(cfg.script, url, headers);
         script_init(L, t, argc - optind, &argv[optind]);
@@ -199,14 +516,15 @@ int main(int argc, char **argv) {
             cfg.pipeline = script_verify_request(t->L);
             cfg.dynamic  = !script_is_static(t->L);
             cfg.delay    = script_has_delay(t->L);
-            if (script_want_response(t->L)) {
+            cfg.response = script_want_response(t->L);
+            if (cfg.response) {
                 parser_settings.on_header_field = header_field;
                 parser_settings.on_header_value = header_value;
                 parser_settings.on_body         = response_body;
             }
         }
 
-        if (!t->loop || pthread_create(&t->thread, NULL, &thread_main, t)) {
+        if (pthread_create(&t->thread, NULL, &thread_main, t)) {
             char *msg = strerror(errno);
             fprintf(stderr, "unable to create thread %"PRIu64": %s\n", i, msg);
             inter_process_clear_sync_sockets(cfg.secondaries_num);
@@ -221,21 +539,37 @@ int main(int argc, char **argv) {
     sigfillset(&sa.sa_mask);
     sigaction(SIGINT, &sa, NULL);
 
-    char *time = format_time_s(cfg.duration);
-    printf("Running %s test @ %s\n", time, url);
-    printf("  %"PRIu64" threads and %"PRIu64" connections\n", cfg.threads, cfg.connections);
+    if (!w) {
+        char *time = format_time_s(cfg.duration);
+        fprintf(console, "Running %s test @ %s\n", time, url);
+        fprintf(console, "  %"PRIu64" threads and %"PRIu64" connections", cfg.threads, cfg.connections);
+        if (parent) fprintf(console, " in %"PRIu64" processes", cfg.processes);
+        fprintf(console, "\n");
+        fflush(console);
+    }
 
     uint64_t start    = time_us();
     uint64_t complete = 0;
     uint64_t bytes    = 0;
+    uint64_t syscalls = 0;
     errors errors     = { 0 };
 
-    sleep(cfg.duration);
+    if (parent) {
+        if (!wait_workers()) {
+            fprintf(stderr, "a worker process failed\n");
+            exit(1);
+        }
+    } else if (cfg.interval) {
+        report_intervals(threads, start);
+    } else {
+        sleep(cfg.duration);
+    }
+    heap = zmalloc_used_memory() - heap;
     stop = 1;
 
     uint64_t phase_normal_start_min = 0;
 
-    for (uint64_t i = 0; i < cfg.threads; i++) {
+    for (uint64_t i = 0; i < running; i++) {
         thread *t = &threads[i];
         pthread_join(t->thread, NULL);
 
@@ -247,34 +581,144 @@ int main(int argc, char **argv) {
 
         complete += t->complete;
         bytes    += t->bytes;
+        syscalls += t->syscalls;
+
+        stats_merge(statistics.latency,  t->statistics.latency);
+        stats_merge(statistics.requests, t->statistics.requests);
+        stats_merge(statistics.success,  t->statistics.success);
+        stats_merge(statistics.failure,  t->statistics.failure);
+        stats_merge(statistics.slippage, t->statistics.slippage);
+        stats_free(t->statistics.latency);
+        stats_free(t->statistics.requests);
+        stats_free(t->statistics.success);
+        stats_free(t->statistics.failure);
+        stats_free(t->statistics.slippage);
+        if (!cfg.rate) {
+            stats_merge(statistics.corrected, t->statistics.corrected);
+            stats_free(t->statistics.corrected);
+        }
+        for (int code = 0; code < MAX_STATUS; code++) {
+            status_codes[code] += t->status[code];
+        }
+        for (uint32_t j = 0; j < t->tags_count; j++) {
+            merge_tag(&t->tags[j]);
+        }
+        for (int e = 0; e < MAX_ERRNO; e++) {
+            causes[e] += t->causes[e];
+        }
+        for (int j = 0; j < MAX_SSL_ERRORS && t->ssl_errors[j].count; j++) {
+            count_ssl_error(ssl_errors, t->ssl_errors[j].code, t->ssl_errors[j].count);
+        }
+        if (cfg.arrival) {
+            stats_merge(statistics.queue, t->statistics.queue);
+            stats_free(t->statistics.queue);
+        }
+        if (cfg.phases) {
+            stats_merge(statistics.connect,   t->statistics.connect);
+            stats_merge(statistics.handshake, t->statistics.handshake);
+            stats_merge(statistics.ttfb,      t->statistics.ttfb);
+            stats_merge(statistics.ttlb,      t->statistics.ttlb);
+            stats_free(t->statistics.connect);
+            stats_free(t->statistics.handshake);
+            stats_free(t->statistics.ttfb);
+            stats_free(t->statistics.ttlb);
+        }
+        if (cfg.interval) {
+            stats_free(t->statistics.interval);
+            stats_free(t->snapshot.latency);
+        }
 
-        errors.connect += t->errors.connect;
-        errors.read    += t->errors.read;
-        errors.write   += t->errors.write;
-        errors.timeout += t->errors.timeout;
-        errors.status  += t->errors.status;
-        errors.established += t->errors.established;
-        errors.reconnect += t->errors.reconnect;
+        errors_add(&errors, &t->errors);
     }
 
-    if (phase_normal_start_min != 0) {
+    if (cfg.warmup && phase_normal_start_min != 0) {
         // Measure runtime starting from the first transition to NORMAL phase.
         start = phase_normal_start_min;
     }
-    uint64_t runtime_us = time_us() - start;
+    uint64_t end = time_us();
+
+    if (w) {
+        w->start       = start;
+        w->end         = end;
+        w->complete    = complete;
+        w->bytes       = bytes;
+        w->syscalls    = syscalls;
+        w->heap        = heap;
+        w->connections = connections;
+        w->errors      = errors;
+        worker_export(w);
+        exit(0);
+    }
+
+    if (parent) {
+        start = UINT64_MAX;
+        end   = 0;
+        for (uint64_t i = 0; i < cfg.processes; i++) {
+            worker *r = (worker *) (workers.shared + i * workers.stride);
+            start        = MIN(start, r->start);
+            end          = MAX(end, r->end);
+            complete    += r->complete;
+            bytes       += r->bytes;
+            syscalls    += r->syscalls;
+            heap        += r->heap;
+            connections += r->connections;
+            errors_add(&errors, &r->errors);
+            worker_merge(r);
+        }
+        cfg.delay = script_has_delay(L);
+    }
+
+    uint64_t runtime_us = end - start;
     long double runtime_s   = runtime_us / 1000000.0;
     long double req_per_s   = complete   / runtime_s;
     long double bytes_per_s = bytes      / runtime_s;
 
-    if (complete / cfg.connections > 0) {
-        int64_t interval = runtime_us / (complete / cfg.connections);
-        stats_correct(statistics.latency, interval);
+    if (hdr_log) {
+        if (!cfg.interval) hdr_log_interval(hdr_log, statistics.latency, 0, runtime_us);
+        fclose(hdr_log);
+    }
+
+    if (cfg.output == FORMAT_JSON) {
+        print_json(runtime_us, complete, bytes, syscalls, heap / connections, &errors);
+        goto done;
     }
 
     print_stats_header();
     print_stats("Latency", statistics.latency, format_time_us);
+    if (!cfg.rate) print_stats("Corrected", statistics.corrected, format_time_us);
+    if (errors.status) {
+        print_stats("Success", statistics.success, format_time_us);
+        print_stats("Failure", statistics.failure, format_time_us);
+    }
+    if (cfg.arrival) print_stats("Queue", statistics.queue, format_time_us);
+    if (cfg.rate || cfg.delay) print_stats("Slippage", statistics.slippage, format_time_us);
+    if (cfg.phases) {
+        print_stats("Connect", statistics.connect, format_time_us);
+        if (cfg.ctx) print_stats("Handshake", statistics.handshake, format_time_us);
+        print_stats("TTFB", statistics.ttfb, format_time_us);
+        print_stats("TTLB", statistics.ttlb, format_time_us);
+    }
     print_stats("Req/Sec", statistics.requests, format_metric);
-    if (cfg.latency) print_stats_latency(statistics.latency);
+    if (tags.count) print_tags();
+    if (cfg.latency) {
+        print_stats_latency("Latency", statistics.latency);
+        if (!cfg.rate) print_stats_latency("Corrected", statistics.corrected);
+        if (errors.status) {
+            print_stats_latency("Success", statistics.success);
+            print_stats_latency("Failure", statistics.failure);
+        }
+        if (cfg.arrival) print_stats_latency("Queue", statistics.queue);
+        if (cfg.rate || cfg.delay) print_stats_latency("Slippage", statistics.slippage);
+        if (cfg.phases) {
+            print_stats_latency("Connect", statistics.connect);
+            if (cfg.ctx) print_stats_latency("Handshake", statistics.handshake);
+            print_stats_latency("TTFB", statistics.ttfb);
+            print_stats_latency("TTLB", statistics.ttlb);
+        }
+        for (uint32_t i = 0; i < tags.count; i++) {
+            print_stats_latency(tags.list[i].name, tags.list[i].latency);
+        }
+    }
 
     char *runtime_msg = format_time_us(runtime_us);
 
@@ -282,19 +726,26 @@ int main(int argc, char **argv) {
     if (errors.connect || errors.read || errors.write || errors.timeout || errors.reconnect) {
         printf("  Socket errors: connect %d, read %d, write %d, timeout %d, reconnect %d\n",
                errors.connect, errors.read, errors.write, errors.timeout, errors.reconnect);
+        print_error_causes();
     }
 
     if (errors.status) {
         printf("  Non-2xx or 3xx responses: %d\n", errors.status);
+        print_status_codes();
     }
 
     printf("Established connections: %u\n", errors.established);
     printf("Requests/sec: %9.2Lf\n", req_per_s);
     printf("Transfer/sec: %10sB\n", format_binary(bytes_per_s));
+    printf("Syscalls/req: %9.2Lf\n", complete ? (long double) syscalls / complete : 0.0L);
+    printf("Memory/conn:  %9sB\n", format_binary((long double) heap / connections));
 
+  done:
     if (script_has_done(L)) {
         script_summary(L, runtime_us, complete, bytes);
         script_errors(L, &errors);
+        script_tags(L, tags.list, tags.count);
+        if (!cfg.rate) script_corrected(L, statistics.corrected);
         script_done(L, statistics.latency, statistics.requests);
     }
 
@@ -309,18 +760,20 @@ static void phase_move(thread *thread, int phase, bool timeout) {
     if (thread->phase == PHASE_WARMUP && phase == PHASE_NORMAL) {
         connection *c  = thread->cs;
 
-        printf("Warmup phase is %s (thread=%p, duration=%"PRIu64"sec).\n",
+        fprintf(console, "Warmup phase is %s (thread=%p, duration=%"PRIu64"sec).\n",
                timeout ? "timed out" : "ended",
                thread, (time_us() - thread->start) / 1000000UL);
 
         for (uint64_t i = 0; i < thread->connections; i++, c++) {
             if (c->is_connected) {
-                aeCreateFileEvent(thread->loop, c->fd, AE_READABLE, socket_readable, c);
-                aeCreateFileEvent(thread->loop, c->fd, AE_WRITABLE, socket_writeable, c);
+                aeCreateFileEvent(thread->loop, c->fd, readable, socket_readable, c);
+                connection_ready(thread, c);
             }
         }
-        thread->start = time_us();
+        // Same clock as record_rate() reads, so its intervals never go negative.
+        thread->start = aeNow(thread->loop);
         thread->phase_normal_start = thread->start;
+        if (cfg.arrival) start_arrivals(thread);
     }
 
     thread->phase = phase;
@@ -345,25 +798,104 @@ static int inter_thread_sync(aeEventLoop *loop, long long id, void *data) {
     return thread->phase == PHASE_NORMAL ? AE_NOMORE : THREAD_SYNC_INTERVAL_MS;
 }
 
+// Everything the thread touches while it runs is allocated by the thread
+// itself once pinned, so first-touch places it on the thread's NUMA node.
+static void thread_alloc(thread *t) {
+    // Sized for the thread's own connections, ae grows it if needed.
+    t->loop = aeCreateEventLoop(t->connections + 16);
+    if (t->loop == NULL) {
+        fprintf(stderr, "unable to create %s event loop: %s\n", aeGetApiName(), strerror(errno));
+        exit(1);
+    }
+    t->statistics.latency  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    t->statistics.requests = stats_alloc(MAX_THREAD_RATE_S, cfg.digits);
+    t->statistics.success  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    if (!cfg.rate) {
+        t->statistics.corrected = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    }
+    t->statistics.failure  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    t->statistics.slippage = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    if (cfg.arrival) {
+        t->statistics.queue = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    }
+    if (cfg.phases) {
+        t->statistics.connect   = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        t->statistics.handshake = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        t->statistics.ttfb      = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        t->statistics.ttlb      = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    }
+    if (cfg.interval) {
+        t->statistics.interval = stats_alloc(cfg.timeout * 1000, cfg.digits);
+        t->snapshot.latency    = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    }
+
+    t->cs   = zcalloc(t->connections * sizeof(connection));
+    t->cold = zcalloc(t->connections * sizeof(connection_cold));
+    t->buf  = zmalloc(cfg.read_size);
+    if (cfg.arrival) {
+        t->idle = zcalloc(t->connections * sizeof(connection *));
+    }
+
+    if (cfg.mlock) {
+        // Histograms grow and pages fault on first use, do both up front.
+        stats *all[] = {
+            t->statistics.latency, t->statistics.requests, t->statistics.interval,
+            t->statistics.queue, t->statistics.corrected, t->statistics.success,
+            t->statistics.failure, t->statistics.connect, t->statistics.handshake,
+            t->statistics.ttfb, t->statistics.ttlb, t->statistics.slippage,
+            t->snapshot.latency,
+        };
+        for (size_t i = 0; i < ARRAY_SIZE(all); i++) {
+            if (all[i]) stats_reserve(all[i]);
+        }
+        memset(t->buf, 0, cfg.read_size);
+    }
+}
+
 void *thread_main(void *arg) {
     thread *thread = arg;
 
+    if (thread->cpu >= 0) {
+        int rc = affinity_pin(thread->cpu);
+        if (rc) {
+            fprintf(stderr, "unable to pin thread to CPU %d: %s\n", thread->cpu, strerror(rc));
+            exit(1);
+        }
+    }
+    thread_alloc(thread);
+
+#ifdef __linux__
+    // The default 50us timer slack would dominate sub-millisecond delays.
+    prctl(PR_SET_TIMERSLACK, 1);
+#endif
+
     char *request = NULL;
     size_t length = 0;
 
     if (!cfg.dynamic) {
-        script_request(thread->L, &request, &length);
+        script_request(thread->L, NULL, &request, &length);
     }
 
-    thread->cs = zcalloc(thread->connections * sizeof(connection));
-    connection *c = thread->cs;
+    if (cfg.rate && !cfg.arrival) {
+        // Nanoseconds between the intended starts of consecutive requests
+        // on one connection, each write sends cfg.pipeline requests. Every
+        // connection gets the same share even when the threads have a
+        // different number of them.
+        long double rate = (long double) cfg.rate / cfg.connections;
+        thread->period = MAX(1000000000.0L * cfg.pipeline / rate, 1);
+    }
 
+    connection *c = thread->cs;
     for (uint64_t i = 0; i < thread->connections; i++, c++) {
-        c->thread = thread;
-        c->ssl     = cfg.ctx ? SSL_new(cfg.ctx) : NULL;
+        c->thread  = thread;
+        c->cold    = &thread->cold[i];
+        c->cold->ssl = cfg.ctx ? SSL_new(cfg.ctx) : NULL;
         c->request = request;
         c->length  = length;
         c->delayed = cfg.delay;
+        c->timer   = -1;
+        c->deadline.proc       = socket_timeout;
+        c->deadline.clientData = c;
         connect_socket(thread, c);
     }
 
@@ -385,10 +917,17 @@ void *thread_main(void *arg) {
 
     thread->start = time_us();
     thread->phase = cfg.warmup ? PHASE_WARMUP : PHASE_NORMAL;
+    if (thread->phase == PHASE_NORMAL) thread->phase_normal_start = thread->start;
+    if (cfg.arrival && thread->phase == PHASE_NORMAL) start_arrivals(thread);
     aeMain(loop);
 
+    thread->syscalls += loop->syscalls;
     aeDeleteEventLoop(loop);
+    zfree(thread->arrivals.queue);
+    zfree(thread->idle);
     zfree(thread->cs);
+    zfree(thread->cold);
+    zfree(thread->buf);
 
     return NULL;
 }
@@ -475,6 +1014,11 @@ static int connect_socket(thread *thread, connection *c) {
     flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 
+    if (cfg.phases) {
+        c->cold->connecting = time_us();
+        c->cold->connected  = 0;
+    }
+
     if (connect(fd, addr->ai_addr, addr->ai_addrlen) == -1) {
         if (errno != EINPROGRESS) goto error;
     }
@@ -482,24 +1026,86 @@ static int connect_socket(thread *thread, connection *c) {
     flags = 1;
     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
 
+    // socket(), two fcntl(), connect() and setsockopt().
+    thread->syscalls += thread->local_ip != NULL ? 6 : 5;
+
     flags = AE_READABLE | AE_WRITABLE;
-    c->connect_mask = flags;
+    c->cold->connect_mask = flags;
     if (aeCreateFileEvent(loop, fd, flags, socket_connected, c) == AE_OK) {
         c->parser.data = c;
         c->fd = fd;
+        aeSetDeadline(loop, &c->deadline, cfg.timeout);
         return fd;
     }
 
   error:
     thread->errors.connect++;
+    c->cold->error = errno;
+    record_error(thread, c);
     close(fd);
+    // Nothing is left to fire for this connection, try again shortly.
+    c->fd = -1;
+    aeClearDeadline(loop, &c->deadline);
+    c->timer = aeCreateTimeEvent(loop, CONNECT_RETRY_MS, retry_connect, c, NULL);
     return -1;
 }
 
+static int retry_connect(aeEventLoop *loop, long long id, void *data) {
+    connection *c = data;
+    c->timer = -1;
+    reconnect_socket(c->thread, c);
+    return AE_NOMORE;
+}
+
+// Count a failed connection by the errno or TLS error the socket layer
+// saw. Errors without either, e.g. an early EOF or a malformed response,
+// are counted under errno 0.
+static void record_error(thread *thread, connection *c) {
+    if (c->cold->ssl_error) {
+        count_ssl_error(thread->ssl_errors, c->cold->ssl_error, 1);
+    } else {
+        thread->causes[c->cold->error > 0 && c->cold->error < MAX_ERRNO ? c->cold->error : 0]++;
+    }
+    c->cold->error     = 0;
+    c->cold->ssl_error = 0;
+}
+
+// Codes that do not fit the table are folded into its last slot.
+static void count_ssl_error(error_count *errors, unsigned long code, uint32_t count) {
+    int i = 0;
+    while (i < MAX_SSL_ERRORS - 1 && errors[i].count && errors[i].code != code) i++;
+    if (!errors[i].count) errors[i].code = code;
+    errors[i].count += count;
+}
+
+// A connect or request outlived --timeout: give up on the socket and start
+// over, the connection's next request will follow on the new one.
+static void socket_timeout(aeEventLoop *loop, void *data) {
+    connection *c = data;
+    thread *thread = c->thread;
+
+    if (c->is_connected) {
+        thread->errors.timeout++;
+        c->scheduled += thread->period;
+    } else {
+        thread->errors.connect++;
+        c->cold->error = ETIMEDOUT;
+        record_error(thread, c);
+    }
+
+    reconnect_socket(thread, c);
+}
+
 static int reconnect_socket(thread *thread, connection *c) {
-    aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
-    sock.close(c);
-    close(c->fd);
+    // The new socket schedules its own first request.
+    aeDeleteTimeEvent(thread->loop, c->timer);
+    c->timer = -1;
+    if (c->fd >= 0) {
+        aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
+        sock.close(c);
+        close(c->fd);
+        thread->syscalls++;
+    }
     thread->errors.reconnect++;
     return connect_socket(thread, c);
 }
@@ -507,51 +1113,316 @@ static int reconnect_socket(thread *thread, connection *c) {
 static int record_rate(aeEventLoop *loop, long long id, void *data) {
     thread *thread = data;
 
+    uint64_t now = aeNow(loop);
+
     if (thread->requests > 0) {
-        uint64_t elapsed_ms = (time_us() - thread->start) / 1000;
+        uint64_t elapsed_ms = (now - thread->start) / 1000;
         uint64_t requests = (thread->requests / (double) elapsed_ms) * 1000;
 
-        stats_record(statistics.requests, requests);
+        stats_record(thread->statistics.requests, requests);
 
         thread->requests = 0;
-        thread->start    = time_us();
+        thread->start    = now;
+    }
+
+    if (!cfg.rate && thread->complete >= thread->connections) {
+        // Average time each connection has spent per write so far, the
+        // interval a closed-loop client would have kept without stalls.
+        // Latency is recorded once per batch of cfg.pipeline responses.
+        uint64_t elapsed = now - thread->phase_normal_start;
+        thread->expected = elapsed * cfg.pipeline / (thread->complete / thread->connections);
     }
 
+    if (cfg.interval) publish_interval(thread);
+
     if (stop) aeStop(loop);
 
     return RECORD_INTERVAL_MS;
 }
 
+// Runs on the thread's own event loop: hand the histogram recorded since the
+// last epoch to the main thread and continue recording into the spare one.
+// The spare is only free once the main thread has merged the previous
+// snapshot, until then the live histogram keeps recording.
+static void publish_interval(thread *thread) {
+    uint64_t epoch = __atomic_load_n(&g_interval_epoch, __ATOMIC_ACQUIRE);
+    if (thread->epoch == epoch) return;
+    if (__atomic_load_n(&thread->consumed, __ATOMIC_ACQUIRE) != thread->epoch) return;
+
+    stats *latency = thread->statistics.interval;
+    thread->statistics.interval = thread->snapshot.latency;
+    thread->snapshot.latency    = latency;
+    thread->snapshot.complete   = thread->complete;
+    thread->snapshot.bytes      = thread->bytes;
+    thread->snapshot.errors     = thread->errors;
+
+    __atomic_store_n(&thread->epoch, epoch, __ATOMIC_RELEASE);
+}
+
+// Index + 1 of the named tag in the thread's own table, which is only
+// touched by that thread until it has been joined.
+uint32_t tag_lookup(thread *thread, const char *name) {
+    for (uint32_t i = 0; i < thread->tags_count; i++) {
+        if (!strcmp(thread->tags[i].name, name)) return i + 1;
+    }
+
+    thread->tags = zrealloc(thread->tags, (thread->tags_count + 1) * sizeof(tag));
+    tag *t = &thread->tags[thread->tags_count++];
+    t->name     = zstrdup(name);
+    t->complete = 0;
+    t->errors   = 0;
+    t->latency  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    return thread->tags_count;
+}
+
+static void merge_tag(tag *src) {
+    tag *dst = NULL;
+
+    for (uint32_t i = 0; i < tags.count && !dst; i++) {
+        if (!strcmp(tags.list[i].name, src->name)) dst = &tags.list[i];
+    }
+
+    if (!dst) {
+        tags.list = zrealloc(tags.list, (tags.count + 1) * sizeof(tag));
+        dst = &tags.list[tags.count++];
+        dst->name     = src->name;
+        dst->complete = 0;
+        dst->errors   = 0;
+        dst->latency  = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    } else {
+        zfree(src->name);
+    }
+
+    dst->complete += src->complete;
+    dst->errors   += src->errors;
+    stats_merge(dst->latency, src->latency);
+    stats_free(src->latency);
+}
+
+static void errors_add(errors *dst, errors *src) {
+    dst->connect     += src->connect;
+    dst->read        += src->read;
+    dst->write       += src->write;
+    dst->timeout     += src->timeout;
+    dst->status      += src->status;
+    dst->established += src->established;
+    dst->reconnect   += src->reconnect;
+}
+
+static uint64_t errors_total(errors *errors) {
+    return (uint64_t) errors->connect + errors->read + errors->write
+         + errors->timeout + errors->status;
+}
+
+static void sleep_until(uint64_t deadline) {
+    uint64_t now;
+    while (!stop && (now = time_us()) < deadline) {
+        uint64_t us = deadline - now;
+        struct timespec ts = {
+            .tv_sec  = us / 1000000,
+            .tv_nsec = (us % 1000000) * 1000,
+        };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void report_intervals(thread *threads, uint64_t start) {
+    uint64_t (*seen)[3] = zcalloc(cfg.threads * sizeof(*seen));
+    stats *latency = stats_alloc(cfg.timeout * 1000, cfg.digits);
+    uint64_t end  = start + cfg.duration * 1000000;
+    uint64_t last = start;
+    uint64_t prev = start;
+
+    print_interval_header();
+
+    while (!stop && last < end) {
+        uint64_t next = MIN(last + cfg.interval * 1000000, end);
+        sleep_until(next);
+        if (stop) break;
+
+        uint64_t epoch = __atomic_add_fetch(&g_interval_epoch, 1, __ATOMIC_ACQ_REL);
+
+        // Threads publish from record_rate(), a snapshot that misses the
+        // deadline is merged into the next interval instead.
+        uint64_t deadline = time_us() + RECORD_INTERVAL_MS * 2000;
+        uint64_t pending  = cfg.threads;
+        while (pending && time_us() < deadline) {
+            pending = 0;
+            for (uint64_t i = 0; i < cfg.threads; i++) {
+                if (__atomic_load_n(&threads[i].epoch, __ATOMIC_ACQUIRE) != epoch) pending++;
+            }
+            if (pending) usleep(1000);
+        }
+
+        uint64_t complete = 0, bytes = 0, failures = 0;
+        for (uint64_t i = 0; i < cfg.threads; i++) {
+            thread *t = &threads[i];
+            uint64_t published = __atomic_load_n(&t->epoch, __ATOMIC_ACQUIRE);
+            if (published == t->consumed) continue;
+
+            uint64_t total = errors_total(&t->snapshot.errors);
+            complete += t->snapshot.complete - seen[i][0];
+            bytes    += t->snapshot.bytes    - seen[i][1];
+            failures += total                - seen[i][2];
+            seen[i][0] = t->snapshot.complete;
+            seen[i][1] = t->snapshot.bytes;
+            seen[i][2] = total;
+
+            stats_merge(latency, t->snapshot.latency);
+            stats_reset(t->snapshot.latency);
+            __atomic_store_n(&t->consumed, published, __ATOMIC_RELEASE);
+        }
+
+        uint64_t now = time_us();
+        print_interval(next - start, now - prev, complete, bytes, failures, latency);
+        if (hdr_log) hdr_log_interval(hdr_log, latency, prev - start, now - prev);
+        stats_reset(latency);
+        last = next;
+        prev = now;
+    }
+
+    stats_free(latency);
+    zfree(seen);
+}
+
+static void arrivals_push(thread *thread, uint64_t at) {
+    if (thread->arrivals.count == thread->arrivals.size) {
+        size_t size = thread->arrivals.size ? thread->arrivals.size * 2 : 1024;
+        uint64_t *queue = zmalloc(size * sizeof(uint64_t));
+        for (size_t i = 0; i < thread->arrivals.count; i++) {
+            size_t j = (thread->arrivals.head + i) & (thread->arrivals.size - 1);
+            queue[i] = thread->arrivals.queue[j];
+        }
+        zfree(thread->arrivals.queue);
+        thread->arrivals.queue = queue;
+        thread->arrivals.size  = size;
+        thread->arrivals.head  = 0;
+    }
+    size_t tail = (thread->arrivals.head + thread->arrivals.count) & (thread->arrivals.size - 1);
+    thread->arrivals.queue[tail] = at;
+    thread->arrivals.count++;
+}
+
+static uint64_t arrivals_pop(thread *thread) {
+    uint64_t at = thread->arrivals.queue[thread->arrivals.head];
+    thread->arrivals.head = (thread->arrivals.head + 1) & (thread->arrivals.size - 1);
+    thread->arrivals.count--;
+    return at;
+}
+
+// Nanoseconds until the next arrival on this thread.
+static uint64_t next_arrival(thread *thread) {
+    if (cfg.arrival == ARRIVAL_POISSON) {
+        return -log(1.0 - erand48(thread->arrivals.seed)) * thread->arrivals.mean;
+    }
+    return thread->arrivals.mean;
+}
+
+static void start_arrivals(thread *thread) {
+    uint64_t now = time_us();
+
+    thread->arrivals.mean    = MAX(1000000000.0L * cfg.threads / cfg.rate, 1);
+    thread->arrivals.seed[0] = now;
+    thread->arrivals.seed[1] = now >> 16;
+    thread->arrivals.seed[2] = (uintptr_t) thread;
+    thread->arrivals.next    = now * 1000 + next_arrival(thread);
+    thread->arrivals.due     = now;
+
+    schedule_at(thread->loop, now, generate_arrivals, thread);
+}
+
+// Open-loop generator: queue every arrival that is due, independently of how
+// many requests are outstanding, and hand them to idle connections.
+static int generate_arrivals(aeEventLoop *loop, long long id, void *data) {
+    thread *thread = data;
+    uint64_t now = aeNow(loop);
+
+    stats_record(thread->statistics.slippage, now - thread->arrivals.due);
+
+    while (thread->arrivals.next <= now * 1000) {
+        arrivals_push(thread, thread->arrivals.next / 1000);
+        thread->arrivals.next += next_arrival(thread);
+    }
+
+    // Arrivals that waited longer than the timeout will never be served in
+    // time, drop them rather than letting the queue grow without bound.
+    while (thread->arrivals.count) {
+        uint64_t at = thread->arrivals.queue[thread->arrivals.head];
+        if (now - at < cfg.timeout * 1000) break;
+        arrivals_pop(thread);
+        thread->errors.timeout++;
+    }
+
+    dispatch_arrivals(thread);
+
+    thread->arrivals.due = (thread->arrivals.next + 999) / 1000;
+    schedule_at(loop, thread->arrivals.due, generate_arrivals, thread);
+    return AE_NOMORE;
+}
+
+static void dispatch_arrivals(thread *thread) {
+    while (thread->arrivals.count && thread->idle_count) {
+        connection *c = thread->idle[--thread->idle_count];
+        c->idle = false;
+        if (!c->is_connected) continue;
+        c->cold->arrival = arrivals_pop(thread);
+        socket_writeable(thread->loop, c->fd, c, AE_WRITABLE);
+    }
+}
+
+// Called when a connection can send its next request. In open-loop mode the
+// connection waits on the idle stack until an arrival is dispatched to it.
+static void connection_ready(thread *thread, connection *c) {
+    if (!cfg.arrival || c->cold->arrival) {
+        socket_writeable(thread->loop, c->fd, c, AE_WRITABLE);
+        return;
+    }
+    if (!c->idle) {
+        c->idle = true;
+        thread->idle[thread->idle_count++] = c;
+    }
+    dispatch_arrivals(thread);
+}
+
+// Run a one-shot time event at a time_us() instant, with the microsecond
+// resolution of the event loop rather than rounded to milliseconds.
+static long long schedule_at(aeEventLoop *loop, uint64_t at, aeTimeProc *proc, void *data) {
+    uint64_t now = time_us();
+    return aeCreateTimeEventUs(loop, at > now ? at - now : 0, proc, data, NULL);
+}
+
 static int delay_request(aeEventLoop *loop, long long id, void *data) {
     connection *c = data;
+    c->timer = -1;
+    stats_record(c->thread->statistics.slippage, aeNow(loop) - c->due);
     c->delayed = false;
-    aeCreateFileEvent(loop, c->fd, AE_WRITABLE, socket_writeable, c);
+    socket_writeable(loop, c->fd, c, AE_WRITABLE);
     return AE_NOMORE;
 }
 
 static int header_field(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
-    if (c->state == VALUE) {
-        *c->headers.cursor++ = '\0';
-        c->state = FIELD;
+    if (c->cold->state == VALUE) {
+        *c->cold->headers.cursor++ = '\0';
+        c->cold->state = FIELD;
     }
-    buffer_append(&c->headers, at, len);
+    buffer_append(&c->cold->headers, at, len);
     return 0;
 }
 
 static int header_value(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
-    if (c->state == FIELD) {
-        *c->headers.cursor++ = '\0';
-        c->state = VALUE;
+    if (c->cold->state == FIELD) {
+        *c->cold->headers.cursor++ = '\0';
+        c->cold->state = VALUE;
     }
-    buffer_append(&c->headers, at, len);
+    buffer_append(&c->cold->headers, at, len);
     return 0;
 }
 
 static int response_body(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
-    buffer_append(&c->body, at, len);
+    buffer_append(&c->cold->body, at, len);
     return 0;
 }
 
@@ -563,23 +1434,47 @@ static int response_complete(http_parser *parser) {
 
     thread->complete++;
     thread->requests++;
+    thread->status[status < MAX_STATUS ? status : 0]++;
+    if (c->tag) thread->tags[c->tag - 1].complete++;
 
     if (status > 399) {
         thread->errors.status++;
+        if (c->tag) thread->tags[c->tag - 1].errors++;
+        c->failed = true;
     }
 
-    if (c->headers.buffer) {
-        *c->headers.cursor++ = '\0';
-        script_response(thread->L, status, &c->headers, &c->body);
-        c->state = FIELD;
+    // No headers were buffered if the response had none.
+    if (cfg.response && c->cold->headers.buffer) {
+        *c->cold->headers.cursor++ = '\0';
+        script_response(thread->L, status, &c->cold->headers, &c->cold->body);
+        c->cold->state = FIELD;
     }
 
     if (--c->pending == 0) {
-        if (!stats_record(statistics.latency, now - c->start)) {
+        uint64_t latency = now - c->start;
+        aeClearDeadline(thread->loop, &c->deadline);
+        c->scheduled += thread->period;
+        if (!stats_record(thread->statistics.latency, latency)) {
             thread->errors.timeout++;
+        } else {
+            // A batch counts as failed if any of its pipelined responses did.
+            stats *outcome = c->failed ? thread->statistics.failure : thread->statistics.success;
+            stats_record(outcome, latency);
+            if (thread->statistics.corrected) {
+                stats_record(thread->statistics.corrected, latency);
+                stats_record_series(thread->statistics.corrected, latency, thread->expected);
+            }
+            if (c->tag) stats_record(thread->tags[c->tag - 1].latency, latency);
+            if (thread->statistics.interval) {
+                stats_record(thread->statistics.interval, latency);
+            }
+        }
+        c->failed = false;
+        if (cfg.phases) {
+            stats_record(thread->statistics.ttfb, c->cold->first_byte - c->cold->sent);
+            stats_record(thread->statistics.ttlb, now - c->cold->sent);
         }
         c->delayed = cfg.delay;
-        aeCreateFileEvent(thread->loop, c->fd, AE_WRITABLE, socket_writeable, c);
     }
 
     if (!http_should_keep_alive(parser)) {
@@ -588,6 +1483,7 @@ static int response_complete(http_parser *parser) {
     }
 
     http_parser_init(parser, HTTP_RESPONSE);
+    if (c->pending == 0) connection_ready(thread, c);
 
   done:
     return 0;
@@ -600,29 +1496,36 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
     int del_flags = 0;
     int rc;
 
+    // The first readiness event after connect() marks TCP establishment,
+    // anything after that until sock.connect() succeeds is the handshake.
+    if (cfg.phases && !c->cold->connected) {
+        c->cold->connected = time_us();
+        stats_record(c->thread->statistics.connect, c->cold->connected - c->cold->connecting);
+    }
+
     switch (sock.connect(c, cfg.host, &retry_flags)) {
         case OK:    break;
         case ERROR: goto error;
         case RETRY:
             // Remove non-reqeusted events not to consume 100% of CPU because of
             // polling TLS socket during TLS handshake phase.
-            if ((retry_flags & E_WANT_READ) && !(c->connect_mask & AE_READABLE))
+            if ((retry_flags & E_WANT_READ) && !(c->cold->connect_mask & AE_READABLE))
                 add_flags |= AE_READABLE;
-            if (!(retry_flags & E_WANT_READ) && (c->connect_mask & AE_READABLE))
+            if (!(retry_flags & E_WANT_READ) && (c->cold->connect_mask & AE_READABLE))
                 del_flags |= AE_READABLE;
-            if ((retry_flags & E_WANT_WRITE) && !(c->connect_mask & AE_WRITABLE))
+            if ((retry_flags & E_WANT_WRITE) && !(c->cold->connect_mask & AE_WRITABLE))
                 add_flags |= AE_WRITABLE;
-            if (!(retry_flags & E_WANT_WRITE) && (c->connect_mask & AE_WRITABLE))
+            if (!(retry_flags & E_WANT_WRITE) && (c->cold->connect_mask & AE_WRITABLE))
                 del_flags |= AE_WRITABLE;
             assert((add_flags & del_flags) == 0);
             if (del_flags != 0) {
                 aeDeleteFileEvent(loop, c->fd, del_flags);
-                c->connect_mask &= ~del_flags;
+                c->cold->connect_mask &= ~del_flags;
             }
             if (add_flags != 0) {
                 rc = aeCreateFileEvent(loop, c->fd, add_flags, socket_connected, c);
                 assert(rc == AE_OK);
-                c->connect_mask |= add_flags;
+                c->cold->connect_mask |= add_flags;
             }
             return;
     }
@@ -631,16 +1534,26 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
         return;
     }
 
+    if (cfg.phases && cfg.ctx) {
+        stats_record(c->thread->statistics.handshake, time_us() - c->cold->connected);
+    }
+
+    aeClearDeadline(loop, &c->deadline);
+
     http_parser_init(&c->parser, HTTP_RESPONSE);
     c->written = 0;
     c->thread->errors.established++;
     c->is_connected = true;
 
     // Create file events only in NORMAL phase. We create the events for connected
-    // sockets when move from WARMUP to NORMAL phase.
+    // sockets when move from WARMUP to NORMAL phase. Writability is polled for
+    // only when a write would block, an idle connection must not stay armed.
     if (c->thread->phase == PHASE_NORMAL) {
-        aeCreateFileEvent(c->thread->loop, fd, AE_READABLE, socket_readable, c);
-        aeCreateFileEvent(c->thread->loop, fd, AE_WRITABLE, socket_writeable, c);
+        aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+        aeCreateFileEvent(loop, fd, readable, socket_readable, c);
+        connection_ready(c->thread, c);
+    } else {
+        aeDeleteFileEvent(loop, fd, AE_READABLE | AE_WRITABLE);
     }
 
     if (cfg.warmup && c->thread->errors.established == c->thread->connections) {
@@ -659,6 +1572,7 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
 
   error:
     c->thread->errors.connect++;
+    record_error(c->thread, c);
     reconnect_socket(c->thread, c);
 }
 
@@ -667,18 +1581,44 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
     thread *thread = c->thread;
 
     if (c->delayed) {
-        uint64_t delay = script_delay(thread->L);
+        c->due = time_us() + script_delay(thread->L);
         aeDeleteFileEvent(loop, fd, AE_WRITABLE);
-        aeCreateTimeEvent(loop, delay, delay_request, c, NULL);
+        c->timer = schedule_at(loop, c->due, delay_request, c);
         return;
     }
 
     if (!c->written) {
+        uint64_t now = time_us();
+        uint64_t start = now;
+
+        if (cfg.arrival) {
+            stats_record(thread->statistics.queue, now - c->cold->arrival);
+            c->cold->arrival = 0;
+        } else if (cfg.rate) {
+            if (!c->scheduled) {
+                // Spread the first request of each connection over one period.
+                uint64_t offset = thread->period * (c - thread->cs) / thread->connections;
+                c->scheduled = now * 1000 + offset;
+            }
+            if (c->scheduled > now * 1000) {
+                c->due = (c->scheduled + 999) / 1000;
+                aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+                c->timer = schedule_at(loop, c->due, delay_request, c);
+                return;
+            }
+            start = c->scheduled / 1000;
+        }
+
         if (cfg.dynamic) {
-            script_request(thread->L, &c->request, &c->length);
+            c->tag = script_request(thread->L, thread, &c->request, &c->length);
         }
-        c->start   = time_us();
+        aeSetDeadline(loop, &c->deadline, cfg.timeout);
+        c->start   = start;
         c->pending = cfg.pipeline;
+        if (cfg.phases) {
+            c->cold->sent       = now;
+            c->cold->first_byte = 0;
+        }
     }
 
     char  *buf = c->request + c->written;
@@ -688,50 +1628,58 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
     switch (sock.write(c, buf, len, &n)) {
         case OK:    break;
         case ERROR: goto error;
-        case RETRY: return;
+        case RETRY:
+            aeCreateFileEvent(loop, fd, AE_WRITABLE, socket_writeable, c);
+            return;
     }
 
+    // Writability is only polled for once the socket buffer is full.
     c->written += n;
     if (c->written == c->length) {
         c->written = 0;
         aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+    } else {
+        aeCreateFileEvent(loop, fd, AE_WRITABLE, socket_writeable, c);
     }
 
     return;
 
   error:
     thread->errors.write++;
+    record_error(thread, c);
     reconnect_socket(thread, c);
 }
 
 static void socket_readable(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
+    thread *thread = c->thread;
     size_t n;
 
     do {
-        switch (sock.read(c, &n)) {
+        switch (sock.read(c, thread->buf, cfg.read_size, &n)) {
             case OK:    break;
             case ERROR: goto error;
             case RETRY: return;
         }
 
-        if (http_parser_execute(&c->parser, &parser_settings, c->buf, n) != n) goto error;
+        if (cfg.phases && n && !c->cold->first_byte) c->cold->first_byte = time_us();
+        if (http_parser_execute(&c->parser, &parser_settings, thread->buf, n) != n) goto error;
         if (n == 0 && !http_body_is_final(&c->parser)) goto error;
 
-        c->thread->bytes += n;
-    } while (n == RECVBUF && sock.readable(c) > 0);
+        thread->bytes += n;
+    } while (n == cfg.read_size);
 
     return;
 
   error:
-    c->thread->errors.read++;
-    reconnect_socket(c->thread, c);
+    thread->errors.read++;
+    record_error(thread, c);
+    reconnect_socket(thread, c);
 }
 
+// Monotonic, latency measurements must not jump with the system clock.
 static uint64_t time_us() {
-    struct timeval t;
-    gettimeofday(&t, NULL);
-    return (t.tv_sec * 1000000) + t.tv_usec;
+    return getMonotonicUs();
 }
 
 char *copy_url_part(const char *url, struct http_parser_url *parts, enum http_parser_url_fields field) {
@@ -754,7 +1702,10 @@ static struct option longopts[] = {
     { "threads",        required_argument, NULL, 't' },
     { "script",         required_argument, NULL, 's' },
     { "header",         required_argument, NULL, 'H' },
+    { "rate",           required_argument, NULL, 'R' },
+    { "arrival",        required_argument, NULL,  0  },
     { "latency",        no_argument,       NULL, 'L' },
+    { "phases",         no_argument,       NULL,  0  },
     { "timeout",        required_argument, NULL, 'T' },
     { "help",           no_argument,       NULL, 'h' },
     { "version",        no_argument,       NULL, 'v' },
@@ -762,11 +1713,22 @@ static struct option longopts[] = {
     { "sync",           required_argument, NULL, 'S' },
     { "warmup",         no_argument,       NULL, 'W' },
     { "warmup-timeout", required_argument, NULL,  0  },
+    { "precision",      required_argument, NULL,  0  },
+    { "interval",       required_argument, NULL,  0  },
+    { "interval-format", required_argument, NULL, 0  },
+    { "output",         required_argument, NULL,  0  },
+    { "hdr-log",        required_argument, NULL,  0  },
+    { "backend",        required_argument, NULL,  0  },
+    { "read-size",      required_argument, NULL,  0  },
+    { "affinity",       required_argument, NULL,  0  },
+    { "mlock",          no_argument,       NULL,  0  },
+    { "processes",      required_argument, NULL,  0  },
     { NULL,             0,                 NULL,  0  }
 };
 
 static int parse_args(struct config *cfg, char **url, struct http_parser_url *parts, char **headers, int argc, char **argv) {
     char **header = headers;
+    bool interval_format = false;
     int option_index;
     int c;
 
@@ -775,8 +1737,11 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
     cfg->connections = 10;
     cfg->duration    = 10;
     cfg->timeout     = SOCKET_TIMEOUT_MS;
+    cfg->digits      = SIGNIFICANT_DIGITS;
+    cfg->read_size   = RECVBUF;
+    cfg->processes   = 1;
 
-    while ((c = getopt_long(argc, argv, "t:c:i:d:s:H:T:p:S:LrWv?", longopts, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "t:c:i:d:s:H:R:T:p:S:LrWv?", longopts, &option_index)) != -1) {
         switch (c) {
             case 't':
                 if (scan_metric(optarg, &cfg->threads)) return -1;
@@ -796,6 +1761,9 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
             case 'H':
                 *header++ = optarg;
                 break;
+            case 'R':
+                if (scan_metric(optarg, &cfg->rate) || !cfg->rate) return -1;
+                break;
             case 'L':
                 cfg->latency = true;
                 break;
@@ -819,6 +1787,73 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
             case 0:
                 if (strcmp(longopts[option_index].name, "warmup-timeout") == 0) {
                     if (scan_time(optarg, &cfg->warmup_timeout)) return -1;
+                } else if (strcmp(longopts[option_index].name, "precision") == 0) {
+                    cfg->digits = atoi(optarg);
+                    if (cfg->digits < STATS_MIN_DIGITS || cfg->digits > STATS_MAX_DIGITS) {
+                        fprintf(stderr, "precision must be between %d and %d digits\n",
+                                STATS_MIN_DIGITS, STATS_MAX_DIGITS);
+                        return -1;
+                    }
+                } else if (strcmp(longopts[option_index].name, "arrival") == 0) {
+                    if (!strcmp(optarg, "constant")) {
+                        cfg->arrival = ARRIVAL_CONSTANT;
+                    } else if (!strcmp(optarg, "poisson")) {
+                        cfg->arrival = ARRIVAL_POISSON;
+                    } else {
+                        fprintf(stderr, "unknown arrival process: %s\n", optarg);
+                        return -1;
+                    }
+                } else if (strcmp(longopts[option_index].name, "phases") == 0) {
+                    cfg->phases = true;
+                } else if (strcmp(longopts[option_index].name, "interval") == 0) {
+                    if (scan_time(optarg, &cfg->interval)) return -1;
+                } else if (strcmp(longopts[option_index].name, "output") == 0) {
+                    if (!strcmp(optarg, "text")) {
+                        cfg->output = FORMAT_TEXT;
+                    } else if (!strcmp(optarg, "json")) {
+                        cfg->output = FORMAT_JSON;
+                    } else {
+                        fprintf(stderr, "unknown output format: %s\n", optarg);
+                        return -1;
+                    }
+                } else if (strcmp(longopts[option_index].name, "hdr-log") == 0) {
+                    cfg->hdr_log = optarg;
+                } else if (strcmp(longopts[option_index].name, "backend") == 0) {
+                    if (aeSelectApi(optarg) != AE_OK) {
+                        fprintf(stderr, "unsupported event loop backend: %s\n", optarg);
+                        return -1;
+                    }
+                } else if (strcmp(longopts[option_index].name, "read-size") == 0) {
+                    if (scan_binary(optarg, &cfg->read_size)) return -1;
+                    if (!cfg->read_size || cfg->read_size > MAX_RECVBUF) {
+                        fprintf(stderr, "read size must be between 1 and %d bytes\n", MAX_RECVBUF);
+                        return -1;
+                    }
+                } else if (strcmp(longopts[option_index].name, "affinity") == 0) {
+                    if (affinity_parse(&cfg->affinity, optarg)) {
+                        if (errno == ENOTSUP) {
+                            fprintf(stderr, "--affinity is not supported on this platform\n");
+                        } else {
+                            fprintf(stderr, "invalid CPU affinity %s: %s\n", optarg, strerror(errno));
+                        }
+                        return -1;
+                    }
+                } else if (strcmp(longopts[option_index].name, "mlock") == 0) {
+                    cfg->mlock = true;
+                } else if (strcmp(longopts[option_index].name, "processes") == 0) {
+                    if (scan_metric(optarg, &cfg->processes) || !cfg->processes) return -1;
+                } else if (strcmp(longopts[option_index].name, "interval-format") == 0) {
+                    interval_format = true;
+                    if (!strcmp(optarg, "text")) {
+                        cfg->interval_format = FORMAT_TEXT;
+                    } else if (!strcmp(optarg, "csv")) {
+                        cfg->interval_format = FORMAT_CSV;
+                    } else if (!strcmp(optarg, "json")) {
+                        cfg->interval_format = FORMAT_JSON;
+                    } else {
+                        fprintf(stderr, "unknown interval format: %s\n", optarg);
+                        return -1;
+                    }
                 }
                 break;
             case 'h':
@@ -836,11 +1871,30 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
         return -1;
     }
 
+    if (cfg->output == FORMAT_JSON && !interval_format) {
+        cfg->interval_format = FORMAT_JSON;
+    }
+
+    if (cfg->arrival && !cfg->rate) {
+        fprintf(stderr, "--arrival requires --rate\n");
+        return -1;
+    }
+
     if (!cfg->connections || cfg->connections < cfg->threads) {
         fprintf(stderr, "number of connections must be >= threads\n");
         return -1;
     }
 
+    if (cfg->processes > cfg->threads) {
+        fprintf(stderr, "number of processes must be <= threads\n");
+        return -1;
+    }
+
+    if (cfg->processes > 1 && (cfg->interval || cfg->sync_ipport)) {
+        fprintf(stderr, "--processes cannot be combined with --interval or --sync\n");
+        return -1;
+    }
+
     *url    = argv[optind];
     *header = NULL;
 
@@ -866,19 +1920,20 @@ static void print_units(long double n, char *(*fmt)(long double), int width) {
 
 static void print_stats(char *name, stats *stats, char *(*fmt)(long double)) {
     uint64_t max = stats->max;
-    long double mean  = stats_mean(stats);
-    long double stdev = stats_stdev(stats, mean);
+    stats_summary summary;
+
+    stats_summarize(stats, &summary);
 
     printf("    %-10s", name);
-    print_units(mean,  fmt, 8);
-    print_units(stdev, fmt, 10);
-    print_units(max,   fmt, 9);
-    printf("%8.2Lf%%\n", stats_within_stdev(stats, mean, stdev, 1));
+    print_units(summary.mean,  fmt, 8);
+    print_units(summary.stdev, fmt, 10);
+    print_units(max,           fmt, 9);
+    printf("%8.2Lf%%\n", summary.within_stdev);
 }
 
-static void print_stats_latency(stats *stats) {
+static void print_stats_latency(char *name, stats *stats) {
     long double percentiles[] = { 50.0, 75.0, 90.0, 99.0 };
-    printf("  Latency Distribution\n");
+    printf("  %s Distribution\n", name);
     for (size_t i = 0; i < sizeof(percentiles) / sizeof(long double); i++) {
         long double p = percentiles[i];
         uint64_t n = stats_percentile(stats, p);
@@ -887,3 +1942,247 @@ static void print_stats_latency(stats *stats) {
         printf("\n");
     }
 }
+
+static void print_json_stats(char *name, stats *stats) {
+    long double percentiles[] = { 50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 99.999 };
+    uint64_t value, count;
+    uint32_t index = 0;
+    stats_summary summary;
+
+    stats_summarize(stats, &summary);
+
+    printf("\"%s\":{\"count\":%"PRIu64",\"min\":%"PRIu64",\"max\":%"PRIu64","
+           "\"mean\":%.2Lf,\"stdev\":%.2Lf,\"percentiles\":{",
+           name, stats->count, stats->count ? stats->min : 0, stats->max,
+           summary.mean, summary.stdev);
+    for (size_t i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        printf("%s\"%g\":%"PRIu64, i ? "," : "", (double) percentiles[i],
+               stats_percentile(stats, percentiles[i]));
+    }
+    printf("},\"buckets\":[");
+    for (int i = 0; stats_next(stats, &index, &value, &count); i++) {
+        printf("%s[%"PRIu64",%"PRIu64"]", i ? "," : "", value, count);
+    }
+    char *encoded = hdr_encode(stats);
+    printf("],\"hdr\":\"%s\"}", encoded);
+    zfree(encoded);
+}
+
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            printf("\\%c", *s);
+        } else if ((unsigned char) *s < 0x20) {
+            printf("\\u%04x", *s);
+        } else {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+// The whole report is a single line so it can follow --interval json lines.
+static void print_json(uint64_t runtime_us, uint64_t complete, uint64_t bytes, uint64_t syscalls, size_t memory, errors *errors) {
+    long double runtime_s = runtime_us / 1000000.0;
+
+    printf("{\"version\":\"%s\",\"threads\":%"PRIu64",\"connections\":%"PRIu64",",
+           VERSION, cfg.threads, cfg.connections);
+    printf("\"duration_us\":%"PRIu64",\"requests\":%"PRIu64",\"bytes\":%"PRIu64","
+           "\"requests_per_sec\":%.2Lf,\"bytes_per_sec\":%.2Lf,\"syscalls\":%"PRIu64","
+           "\"memory_per_connection\":%"PRIu64",",
+           runtime_us, complete, bytes, complete / runtime_s, bytes / runtime_s, syscalls,
+           (uint64_t) memory);
+    printf("\"errors\":{\"connect\":%u,\"read\":%u,\"write\":%u,\"status\":%u,"
+           "\"timeout\":%u,\"established\":%u,\"reconnect\":%u},",
+           errors->connect, errors->read, errors->write, errors->status,
+           errors->timeout, errors->established, errors->reconnect);
+    printf("\"error_causes\":{");
+    int n = 0;
+    for (int e = 0; e < MAX_ERRNO; e++) {
+        if (!causes[e]) continue;
+        printf("%s\"%s\":%u", n++ ? "," : "", e ? errno_name(e) : "protocol", causes[e]);
+    }
+    for (int i = 0; i < MAX_SSL_ERRORS && ssl_errors[i].count; i++) {
+        printf("%s", n++ ? "," : "");
+        print_json_string(ssl_error_name(ssl_errors[i].code));
+        printf(":%u", ssl_errors[i].count);
+    }
+    printf("},");
+    printf("\"status\":{");
+    for (int code = 0, n = 0; code < MAX_STATUS; code++) {
+        if (!status_codes[code]) continue;
+        printf("%s\"%d\":%"PRIu64, n++ ? "," : "", code, status_codes[code]);
+    }
+    printf("},");
+    print_json_stats("latency_us", statistics.latency);
+    if (!cfg.rate) {
+        printf(",");
+        print_json_stats("corrected_us", statistics.corrected);
+    }
+    printf(",");
+    print_json_stats("success_us", statistics.success);
+    printf(",");
+    print_json_stats("failure_us", statistics.failure);
+    printf(",");
+    print_json_stats("requests_per_sec_per_thread", statistics.requests);
+    if (cfg.arrival) {
+        printf(",");
+        print_json_stats("queue_us", statistics.queue);
+    }
+    if (cfg.rate || cfg.delay) {
+        printf(",");
+        print_json_stats("slippage_us", statistics.slippage);
+    }
+    if (tags.count) {
+        printf(",\"tags\":{");
+        for (uint32_t i = 0; i < tags.count; i++) {
+            tag *t = &tags.list[i];
+            printf("%s", i ? "," : "");
+            print_json_string(t->name);
+            printf(":{\"requests\":%"PRIu64",\"errors\":%"PRIu64",", t->complete, t->errors);
+            print_json_stats("latency_us", t->latency);
+            printf("}");
+        }
+        printf("}");
+    }
+    if (cfg.phases) {
+        printf(",");
+        print_json_stats("connect_us", statistics.connect);
+        if (cfg.ctx) {
+            printf(",");
+            print_json_stats("handshake_us", statistics.handshake);
+        }
+        printf(",");
+        print_json_stats("ttfb_us", statistics.ttfb);
+        printf(",");
+        print_json_stats("ttlb_us", statistics.ttlb);
+    }
+    printf("}\n");
+}
+
+// Symbolic name of the errno values sockets fail with, or the number, as
+// strerror() text depends on the libc and the locale.
+static const char *errno_name(int e) {
+    static char number[16];
+
+#define ERRNO_NAME(name) case name: return #name;
+    switch (e) {
+        ERRNO_NAME(EPERM)         ERRNO_NAME(ENOENT)        ERRNO_NAME(EINTR)
+        ERRNO_NAME(EIO)           ERRNO_NAME(EBADF)         ERRNO_NAME(EAGAIN)
+        ERRNO_NAME(ENOMEM)        ERRNO_NAME(EACCES)        ERRNO_NAME(EFAULT)
+        ERRNO_NAME(EINVAL)        ERRNO_NAME(ENFILE)        ERRNO_NAME(EMFILE)
+        ERRNO_NAME(ENOSPC)        ERRNO_NAME(EPIPE)         ERRNO_NAME(EPROTO)
+        ERRNO_NAME(ENOTSOCK)      ERRNO_NAME(EMSGSIZE)      ERRNO_NAME(EPROTOTYPE)
+        ERRNO_NAME(ENOPROTOOPT)   ERRNO_NAME(EOPNOTSUPP)    ERRNO_NAME(EAFNOSUPPORT)
+        ERRNO_NAME(EADDRINUSE)    ERRNO_NAME(EADDRNOTAVAIL) ERRNO_NAME(ENETDOWN)
+        ERRNO_NAME(ENETUNREACH)   ERRNO_NAME(ENETRESET)     ERRNO_NAME(ECONNABORTED)
+        ERRNO_NAME(ECONNRESET)    ERRNO_NAME(ENOBUFS)       ERRNO_NAME(EISCONN)
+        ERRNO_NAME(ENOTCONN)      ERRNO_NAME(ETIMEDOUT)     ERRNO_NAME(ECONNREFUSED)
+        ERRNO_NAME(EHOSTUNREACH)  ERRNO_NAME(EALREADY)      ERRNO_NAME(EINPROGRESS)
+    }
+#undef ERRNO_NAME
+
+    snprintf(number, sizeof(number), "%d", e);
+    return number;
+}
+
+static const char *ssl_error_name(unsigned long code) {
+    const char *name = ERR_reason_error_string(code);
+    return name ? name : "unknown TLS error";
+}
+
+static void print_error_causes() {
+    int n = 0;
+    for (int e = 0; e < MAX_ERRNO; e++) {
+        if (!causes[e]) continue;
+        printf("%s %s %u", n++ ? "," : "  Error causes:", e ? strerror(e) : "protocol", causes[e]);
+    }
+    for (int i = 0; i < MAX_SSL_ERRORS && ssl_errors[i].count; i++) {
+        printf("%s %s %u", n++ ? "," : "  Error causes:", ssl_error_name(ssl_errors[i].code), ssl_errors[i].count);
+    }
+    if (n) printf("\n");
+}
+
+static void print_tags() {
+    printf("  Tag Latency%7s%11s%8s%12s%10s%8s\n",
+           "Avg", "Stdev", "Max", "+/- Stdev", "Requests", "Errors");
+    for (uint32_t i = 0; i < tags.count; i++) {
+        tag *t = &tags.list[i];
+        stats_summary summary;
+
+        stats_summarize(t->latency, &summary);
+
+        printf("    %-10s", t->name);
+        print_units(summary.mean,    format_time_us, 8);
+        print_units(summary.stdev,   format_time_us, 10);
+        print_units(t->latency->max, format_time_us, 9);
+        printf("%8.2Lf%%", summary.within_stdev);
+        printf("%10"PRIu64"%8"PRIu64"\n", t->complete, t->errors);
+    }
+}
+
+static void print_status_codes() {
+    printf("  Status codes:");
+    for (int code = 0, n = 0; code < MAX_STATUS; code++) {
+        if (!status_codes[code]) continue;
+        printf("%s %d: %"PRIu64, n++ ? "," : "", code, status_codes[code]);
+    }
+    printf("\n");
+}
+
+static long double interval_percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+static void print_interval_header() {
+    switch (cfg.interval_format) {
+        case FORMAT_TEXT:
+            printf("  Interval%10s%10s%9s%10s%10s%10s%10s\n",
+                   "Req/Sec", "Transfer", "Errors", "50%", "90%", "99%", "99.9%");
+            break;
+        case FORMAT_CSV:
+            printf("elapsed_us,requests,requests_per_sec,bytes_per_sec,errors");
+            printf(",p50_us,p90_us,p99_us,p99.9_us\n");
+            break;
+    }
+}
+
+static void print_interval(uint64_t elapsed, uint64_t duration, uint64_t complete,
+                           uint64_t bytes, uint64_t failures, stats *latency) {
+    long double duration_s  = duration / 1000000.0;
+    long double req_per_s   = duration_s > 0 ? complete / duration_s : 0;
+    long double bytes_per_s = duration_s > 0 ? bytes    / duration_s : 0;
+    size_t count = ARRAY_SIZE(interval_percentiles);
+
+    switch (cfg.interval_format) {
+        case FORMAT_TEXT:
+            printf("  ");
+            print_units(elapsed, format_time_us, 8);
+            print_units(req_per_s, format_metric, 10);
+            print_units(bytes_per_s, format_binary, 10);
+            printf("%9"PRIu64, failures);
+            for (size_t i = 0; i < count; i++) {
+                print_units(stats_percentile(latency, interval_percentiles[i]), format_time_us, 10);
+            }
+            printf("\n");
+            break;
+        case FORMAT_CSV:
+            printf("%"PRIu64",%"PRIu64",%.2Lf,%.2Lf,%"PRIu64,
+                   elapsed, complete, req_per_s, bytes_per_s, failures);
+            for (size_t i = 0; i < count; i++) {
+                printf(",%"PRIu64, stats_percentile(latency, interval_percentiles[i]));
+            }
+            printf("\n");
+            break;
+        case FORMAT_JSON:
+            printf("{\"elapsed_us\":%"PRIu64",\"requests\":%"PRIu64",\"requests_per_sec\":%.2Lf,"
+                   "\"bytes_per_sec\":%.2Lf,\"errors\":%"PRIu64",\"latency_us\":{",
+                   elapsed, complete, req_per_s, bytes_per_s, failures);
+            for (size_t i = 0; i < count; i++) {
+                printf("%s\"p%g\":%"PRIu64, i ? "," : "", (double) interval_percentiles[i],
+                       stats_percentile(latency, interval_percentiles[i]));
+            }
+            printf("}}\n");
+            break;
+    }
+    fflush(stdout);
+}
@@ -17,14 +17,61 @@
 #include "http_parser.h"
 
 #define RECVBUF  8192
+#define MAX_RECVBUF (1 << 30)
 
 #define MAX_THREAD_RATE_S   10000000
 #define SOCKET_TIMEOUT_MS   2000
+#define CONNECT_RETRY_MS    10
 #define RECORD_INTERVAL_MS  100
+#define SIGNIFICANT_DIGITS  2
+#define MAX_STATUS          600
+#define MAX_ERRNO           256
+#define MAX_SSL_ERRORS      16
 #define THREAD_SYNC_INTERVAL_MS 1000
+#define MAX_WORKER_TAGS     64
 
 extern const char *VERSION;
 
+// Occurrences of one TLS error code.
+typedef struct {
+    unsigned long code;
+    uint32_t count;
+} error_count;
+
+// Latency and counters for requests whose request() returned this tag.
+typedef struct {
+    char *name;
+    uint64_t complete;
+    uint64_t errors;
+    stats *latency;
+} tag;
+
+// Results of a --processes worker, left in memory shared with the parent
+// which merges them once the worker has exited.
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t complete;
+    uint64_t bytes;
+    uint64_t syscalls;
+    uint64_t heap;
+    uint64_t connections;
+    errors errors;
+    uint64_t status[MAX_STATUS];
+    uint32_t causes[MAX_ERRNO];
+    error_count ssl_errors[MAX_SSL_ERRORS];
+    uint32_t tags_count;
+    size_t capacity;
+    char data[]; // stats_export() of each histogram, then each tag
+} worker;
+
+// A tag in worker.data, followed by its name and its stats_export().
+typedef struct {
+    uint64_t complete;
+    uint64_t errors;
+    uint32_t length;
+} worker_tag;
+
 typedef struct {
     pthread_t thread;
     aeEventLoop *loop;
@@ -33,12 +80,57 @@ typedef struct {
     uint64_t complete;
     uint64_t requests;
     uint64_t bytes;
+    uint64_t syscalls;
     uint64_t start;
     uint64_t phase_normal_start;
+    uint64_t period;
+    uint64_t expected;
     int phase;
+    int cpu; // pinned to, -1 if not
     lua_State *L;
     errors errors;
+    uint64_t status[MAX_STATUS];
+    uint32_t causes[MAX_ERRNO];
+    error_count ssl_errors[MAX_SSL_ERRORS];
+    tag *tags;
+    uint32_t tags_count;
+    struct {
+        stats *latency;
+        stats *requests;
+        stats *interval;
+        stats *queue;
+        stats *corrected;
+        stats *success;
+        stats *failure;
+        stats *connect;
+        stats *handshake;
+        stats *ttfb;
+        stats *ttlb;
+        stats *slippage;
+    } statistics;
+    uint64_t epoch;    // interval the snapshot was published for
+    uint64_t consumed; // epoch of the last snapshot the main thread merged
+    struct {
+        uint64_t complete;
+        uint64_t bytes;
+        errors errors;
+        stats *latency;
+    } snapshot;
+    struct {
+        uint64_t *queue;
+        size_t size;
+        size_t head;
+        size_t count;
+        uint64_t next;
+        uint64_t due;
+        uint64_t mean;
+        unsigned short seed[3];
+    } arrivals;
+    struct connection **idle;
+    size_t idle_count;
     struct connection *cs;
+    struct connection_cold *cold;
+    char *buf; // receive buffer shared by the connections, parsed right away
     char *local_ip;
 } thread;
 
@@ -48,29 +140,51 @@ typedef struct {
     char  *cursor;
 } buffer;
 
-typedef struct connection {
-    thread *thread;
-    http_parser parser;
+// State of a connection used only for TLS, errors, --phases, --arrival and
+// response(), kept apart so the connections of a thread pack densely.
+typedef struct connection_cold {
+    SSL *ssl;
+    unsigned long ssl_error;
+    int error;
+    int connect_mask;
     enum {
         FIELD, VALUE
     } state;
-    int fd;
-    int connect_mask;
-    SSL *ssl;
-    bool is_connected;
-    bool delayed;
-    uint64_t start;
+    uint64_t arrival;
+    uint64_t connecting;
+    uint64_t connected;
+    uint64_t sent;
+    uint64_t first_byte;
+    buffer headers;
+    buffer body;
+} connection_cold;
+
+// Fields touched by every request, in the order the write, read and
+// response paths use them.
+typedef struct connection {
+    thread *thread;
     char *request;
     size_t length;
     size_t written;
     uint64_t pending;
-    buffer headers;
-    buffer body;
-    char buf[RECVBUF];
+    uint64_t start;
+    int fd;
+    uint32_t tag;
+    bool is_connected;
+    bool delayed;
+    bool idle;
+    bool failed;
+    http_parser parser;
+    uint64_t scheduled;
+    uint64_t due;
+    long long timer; // pending delay_request() or retry_connect() event, -1 if none
+    connection_cold *cold;
+    aeDeadline deadline;
 } connection;
 
 extern char *g_local_ip;
 
 void bind_socket(int fd, sa_family_t family, const char *addr);
+uint32_t tag_lookup(thread *thread, const char *name);
 
 #endif /* WRK_H */
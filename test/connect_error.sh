@@ -0,0 +1,83 @@
+#!/bin/sh
+# A connect() that fails at once must leave the connection retrying, not
+# dead or holding on to the closed socket. Every 4th connect() fails with
+# EADDRNOTAVAIL and the server closes the connection after each response,
+# so every request needs a new one. A connection that is not retried stops
+# the test in a handful of requests, and closing the old descriptor again
+# on the next reconnect shows up as close() failing with EBADF.
+
+WRK=${WRK:-./wrk}
+PORT=${PORT:-18096}
+
+if [ "$(uname)" != Linux ]; then
+    echo "connect_error: skipped, needs LD_PRELOAD"
+    exit 0
+fi
+
+dir=$(mktemp -d)
+cat > "$dir/fail.c" <<'C'
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+static int connects, ebadf;
+
+int connect(int fd, const struct sockaddr *addr, socklen_t len) {
+    static int (*real)(int, const struct sockaddr *, socklen_t);
+    if (!real) real = dlsym(RTLD_NEXT, "connect");
+    if (__atomic_add_fetch(&connects, 1, __ATOMIC_RELAXED) % 4 == 0) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    return real(fd, addr, len);
+}
+
+int close(int fd) {
+    static int (*real)(int);
+    if (!real) real = dlsym(RTLD_NEXT, "close");
+    int rc = real(fd);
+    if (rc == -1 && errno == EBADF) __atomic_add_fetch(&ebadf, 1, __ATOMIC_RELAXED);
+    return rc;
+}
+
+__attribute__((destructor)) static void report(void) {
+    fprintf(stderr, "ebadf %d\n", ebadf);
+}
+C
+${CC:-cc} -shared -fPIC -o "$dir/fail.so" "$dir/fail.c" -ldl || exit 1
+
+python3 - "$PORT" <<'PY' &
+import socket, sys, threading
+
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(("127.0.0.1", int(sys.argv[1])))
+s.listen(128)
+
+def serve(c):
+    try:
+        if c.recv(4096):
+            c.sendall(b"HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok")
+    except OSError:
+        pass
+    c.close()
+
+while True:
+    c, _ = s.accept()
+    threading.Thread(target=serve, args=(c,), daemon=True).start()
+PY
+server=$!
+trap 'kill $server; rm -rf "$dir"' EXIT
+sleep 1
+
+out=$(LD_PRELOAD="$dir/fail.so" "$WRK" -t1 -c4 -d2s --output json "http://127.0.0.1:$PORT/" 2>"$dir/err")
+requests=$(echo "$out" | sed -n 's/.*"requests": *\([0-9]*\).*/\1/p')
+connect=$(echo "$out" | sed -n 's/.*"connect": *\([0-9]*\).*/\1/p')
+timeout=$(echo "$out" | sed -n 's/.*"timeout": *\([0-9]*\).*/\1/p')
+ebadf=$(sed -n 's/^ebadf //p' "$dir/err")
+
+echo "connect_error: $requests requests, $connect connect errors, $timeout timeouts, $ebadf EBADF"
+[ "$requests" -gt 200 ] && [ "$connect" -gt 50 ] && [ "$timeout" -eq 0 ] && [ "$ebadf" -eq 0 ] &&
+    ! echo "$out" | grep -q ETIMEDOUT
@@ -0,0 +1,45 @@
+#!/bin/sh
+# A connection that is reconnected while its next -R request is waiting on
+# a timer must keep a single timer. The server closes every connection that
+# has been idle for 100ms, well inside the 1s between two requests of one
+# connection, so each request follows a reconnect. With a timer left behind
+# on every reconnect the rate multiplies instead of staying at 8 req/s.
+
+WRK=${WRK:-./wrk}
+PORT=${PORT:-18095}
+
+python3 - "$PORT" <<'PY' &
+import socket, sys, threading
+
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(("127.0.0.1", int(sys.argv[1])))
+s.listen(128)
+
+def serve(c):
+    c.settimeout(0.1)
+    try:
+        while True:
+            data = c.recv(4096)
+            if not data:
+                break
+            for _ in range(data.count(b"\r\n\r\n")):
+                c.sendall(b"HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok")
+    except OSError:
+        pass
+    c.close()
+
+while True:
+    c, _ = s.accept()
+    threading.Thread(target=serve, args=(c,), daemon=True).start()
+PY
+server=$!
+trap 'kill $server' EXIT
+sleep 1
+
+out=$("$WRK" -t1 -c4 -d4s -R8 --timeout 10s --output json "http://127.0.0.1:$PORT/" 2>/dev/null)
+requests=$(echo "$out" | sed -n 's/.*"requests": *\([0-9]*\).*/\1/p')
+reconnects=$(echo "$out" | sed -n 's/.*"reconnect": *\([0-9]*\).*/\1/p')
+
+echo "reconnect: $requests requests, $reconnects reconnects"
+[ "$reconnects" -gt 10 ] && [ "$requests" -ge 24 ] && [ "$requests" -le 40 ]